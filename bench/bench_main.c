@@ -0,0 +1,272 @@
+/**
+ ******************************************************************************
+ * @file           : bench_main.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Host benchmarks of the clients, settings and events
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "clients.c"
+#include "events.c"
+#include "settings.c"
+
+/* Private macros ------------------------------------------------------------*/
+#define BENCH_ROUNDS (2000000 / CLIENTS_MAX + 1)
+#define BENCH_BATCH 64
+#define BENCH_QUEUE_LEN (BENCH_BATCH * 2)
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  const char *name;
+  uint64_t ns;
+  uint64_t ops;
+} bench_result_t;
+
+/* Private variables ---------------------------------------------------------*/
+static clients_t clients;
+static uint8_t macs[CLIENTS_MAX][6];
+static settings_t settings;
+static uint8_t eeprom[sizeof(settings_data_t)];
+
+/* Keeps the optimizer from discarding the measured calls */
+static volatile uintptr_t sink;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t bench_now(void);
+static void bench_report(const bench_result_t *const result);
+static void bench_clients(void);
+static void bench_settings(void);
+static void bench_route(void);
+static void bench_drain(event_t *const event);
+static int eeprom_read_cb(uint8_t data_addr, uint8_t *data, uint32_t data_len);
+static int eeprom_write_cb(uint8_t data_addr, uint8_t *data, uint32_t data_len);
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+  /* Synthetic clients sharing the vendor part of the MAC, as in a real AP */
+  for (uint32_t i = 0; i < CLIENTS_MAX; i++) {
+    uint32_t id = i * 0x9E3779B1UL;
+    macs[i][0] = 0x24;
+    macs[i][1] = 0x0A;
+    macs[i][2] = 0xC4;
+    macs[i][3] = id >> 16;
+    macs[i][4] = id >> 8;
+    macs[i][5] = id;
+  }
+
+  printf("clients: %d\n", CLIENTS_MAX);
+
+  bench_clients();
+  bench_settings();
+  bench_route();
+
+  return 0;
+}
+
+/* Private function definitions ----------------------------------------------*/
+static uint64_t bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_report(const bench_result_t *const result) {
+  printf("  %-16s %10.1f ns/op\n", result->name,
+         (double)result->ns / result->ops);
+}
+
+static void bench_clients(void) {
+  bench_result_t add = {"add"}, find = {"find"}, refresh = {"refresh"},
+                 tick = {"tick"}, expire = {"expire"}, remove = {"remove"};
+  uint64_t start;
+
+  for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+    clients_init(&clients);
+
+    /* Staggered deadlines, the first half is due at the expire step */
+    start = bench_now();
+    for (uint32_t i = 0; i < CLIENTS_MAX; i++) {
+      clients_add(&clients, macs[i], i, (i * 7919) % CLIENTS_MAX);
+    }
+    add.ns += bench_now() - start;
+    add.ops += CLIENTS_MAX;
+
+    start = bench_now();
+    for (uint32_t i = 0; i < CLIENTS_MAX; i++) {
+      sink = (uintptr_t)clients_find(&clients, macs[i]);
+    }
+    find.ns += bench_now() - start;
+    find.ops += CLIENTS_MAX;
+
+    start = bench_now();
+    for (uint32_t i = 0; i < CLIENTS_MAX; i += 2) {
+      clients_add(&clients, macs[i], i, (i * 7919) % CLIENTS_MAX);
+    }
+    refresh.ns += bench_now() - start;
+    refresh.ops += (CLIENTS_MAX + 1) / 2;
+
+    /* What the clients task does on every wakeup with nothing due */
+    start = bench_now();
+    for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+      sink = clients_next_deadline(&clients) > (int64_t)i;
+    }
+    tick.ns += bench_now() - start;
+    tick.ops += BENCH_BATCH;
+
+    start = bench_now();
+    uint32_t expired = 0;
+    while (clients_pop_expired(&clients, CLIENTS_MAX / 2) != NULL) {
+      expired++;
+    }
+    expire.ns += bench_now() - start;
+    expire.ops += expired ? expired : 1;
+
+    start = bench_now();
+    for (uint32_t i = 0; i < CLIENTS_MAX; i++) {
+      clients_remove(&clients, macs[i]);
+    }
+    remove.ns += bench_now() - start;
+    remove.ops += CLIENTS_MAX;
+  }
+
+  bench_report(&add);
+  bench_report(&find);
+  bench_report(&refresh);
+  bench_report(&tick);
+  bench_report(&expire);
+  bench_report(&remove);
+}
+
+static void bench_settings(void) {
+  bench_result_t save = {"settings save"}, load = {"settings load"};
+  uint64_t start;
+
+  settings_init(&settings, eeprom_read_cb, eeprom_write_cb);
+  settings_set_ssid(&settings, "NearFi");
+  settings_set_clients(&settings, 15);
+  settings_set_time(&settings, 60);
+
+  start = bench_now();
+  for (uint32_t i = 0; i < 1000000; i++) {
+    sink = settings_save(&settings);
+  }
+  save.ns = bench_now() - start;
+  save.ops = 1000000;
+
+  start = bench_now();
+  for (uint32_t i = 0; i < 1000000; i++) {
+    sink = settings_load(&settings);
+  }
+  load.ns = bench_now() - start;
+  load.ops = 1000000;
+
+  bench_report(&save);
+  bench_report(&load);
+}
+
+static void bench_route(void) {
+  bench_result_t route_one = {"route 1 cmd"}, route_three = {"route 3 cmds"},
+                 route_payload = {"route payload"};
+  event_t event = {0};
+  uint64_t start;
+
+  /* The app routes and commands queues, drained between batches */
+  alerts_commands_queue = event_queue_create("alerts", BENCH_QUEUE_LEN);
+  network_commands_queue = event_queue_create("network", BENCH_QUEUE_LEN);
+  clients_commands_queue = event_queue_create("clients", BENCH_QUEUE_LEN);
+  actions_commands_queue = event_queue_create("actions", BENCH_QUEUE_LEN);
+
+  for (uint32_t round = 0; round < 20000; round++) {
+    start = bench_now();
+    for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+      event.num = EVENT_TRG_WIFI_AP_STACONNECTED;
+      event_route(&event, event_trg_routes);
+    }
+    route_one.ns += bench_now() - start;
+    route_one.ops += BENCH_BATCH;
+
+    bench_drain(&event);
+
+    start = bench_now();
+    for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+      event.num = EVENT_RSP_NETWORK_OTA_SUCCESS;
+      event_route(&event, event_rsp_routes);
+    }
+    route_three.ns += bench_now() - start;
+    route_three.ops += BENCH_BATCH;
+
+    bench_drain(&event);
+
+    /* Same 3 commands fan-out sharing a pool payload, drain included */
+    start = bench_now();
+    for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+      event.payload = event_payload_alloc();
+      event.num = EVENT_RSP_NETWORK_OTA_SUCCESS;
+      event_route(&event, event_rsp_routes);
+      event_release(&event);
+      bench_drain(&event);
+    }
+    route_payload.ns += bench_now() - start;
+    route_payload.ops += BENCH_BATCH;
+  }
+
+  bench_report(&route_one);
+  bench_report(&route_three);
+  bench_report(&route_payload);
+}
+
+static void bench_drain(event_t *const event) {
+  QueueHandle_t queues[] = {alerts_commands_queue, network_commands_queue,
+                            clients_commands_queue, actions_commands_queue};
+
+  for (uint8_t i = 0; i < sizeof(queues) / sizeof(queues[0]); i++) {
+    while (event_receive(queues[i], event, 0) == pdPASS) {
+      event_release(event);
+    }
+  }
+}
+
+static int eeprom_read_cb(uint8_t data_addr, uint8_t *data, uint32_t data_len) {
+  memcpy(data, eeprom + data_addr, data_len);
+  return 0;
+}
+
+static int eeprom_write_cb(uint8_t data_addr, uint8_t *data,
+                           uint32_t data_len) {
+  memcpy(eeprom + data_addr, data, data_len);
+  return 0;
+}
+
+/***************************** END OF FILE ************************************/
@@ -0,0 +1,110 @@
+/* Copying ring buffer queues with the FreeRTOS API used by the app, the
+ * benchmarks never block so the timeouts are ignored */
+#ifndef QUEUE_H_
+#define QUEUE_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+  uint8_t *buf;
+  size_t item_size;
+  size_t len;
+  size_t head;
+  size_t count;
+} queue_stub_t;
+
+typedef queue_stub_t *QueueHandle_t;
+
+static inline QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t size) {
+  QueueHandle_t queue = calloc(1, sizeof(queue_stub_t));
+
+  if (queue != NULL) {
+    queue->buf = malloc((size_t)len * size);
+    queue->item_size = size;
+    queue->len = len;
+  }
+
+  return queue;
+}
+
+static inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item,
+                                    TickType_t wait) {
+  (void)wait;
+
+  if (queue->count == queue->len) {
+    return errQUEUE_FULL;
+  }
+
+  size_t tail = (queue->head + queue->count++) % queue->len;
+  memcpy(queue->buf + tail * queue->item_size, item, queue->item_size);
+
+  return pdPASS;
+}
+
+static inline BaseType_t xQueueSendToFront(QueueHandle_t queue,
+                                           const void *item, TickType_t wait) {
+  (void)wait;
+
+  if (queue->count == queue->len) {
+    return errQUEUE_FULL;
+  }
+
+  queue->head = (queue->head + queue->len - 1) % queue->len;
+  queue->count++;
+  memcpy(queue->buf + queue->head * queue->item_size, item, queue->item_size);
+
+  return pdPASS;
+}
+
+static inline BaseType_t xQueueSendToFrontFromISR(QueueHandle_t queue,
+                                                  const void *item,
+                                                  BaseType_t *woken) {
+  *woken = pdFALSE;
+  return xQueueSendToFront(queue, item, 0);
+}
+
+static inline BaseType_t xQueueSendFromISR(QueueHandle_t queue,
+                                           const void *item,
+                                           BaseType_t *woken) {
+  *woken = pdFALSE;
+  return xQueueSend(queue, item, 0);
+}
+
+static inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item,
+                                       TickType_t wait) {
+  (void)wait;
+
+  if (queue->count == 0) {
+    return pdFALSE;
+  }
+
+  memcpy(item, queue->buf + queue->head * queue->item_size, queue->item_size);
+  queue->head = (queue->head + 1) % queue->len;
+  queue->count--;
+
+  return pdPASS;
+}
+
+static inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return queue->count;
+}
+
+static inline UBaseType_t uxQueueMessagesWaitingFromISR(QueueHandle_t queue) {
+  return queue->count;
+}
+
+/* The benchmarks never wait on the triggers lanes */
+typedef void *QueueSetHandle_t;
+typedef void *QueueSetMemberHandle_t;
+
+static inline QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set,
+                                                         TickType_t wait) {
+  (void)set;
+  (void)wait;
+  return NULL;
+}
+
+#endif /* QUEUE_H_ */
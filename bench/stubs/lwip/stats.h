@@ -0,0 +1,17 @@
+/* NAPT statistics as exported by the ESP-IDF lwIP port */
+#ifndef LWIP_STATS_H_
+#define LWIP_STATS_H_
+
+#include <stdint.h>
+
+struct stats_ip_napt {
+  uint16_t nr_active_tcp;
+  uint16_t nr_active_udp;
+  uint16_t nr_active_icmp;
+  uint16_t max_active_tcp;
+  uint16_t max_active_udp;
+  uint16_t max_active_icmp;
+  uint32_t nr_forced_evictions;
+};
+
+#endif /* LWIP_STATS_H_ */
@@ -0,0 +1,17 @@
+/* Heap information as returned by heap_caps_get_info() */
+#ifndef MULTI_HEAP_H_
+#define MULTI_HEAP_H_
+
+#include <stddef.h>
+
+typedef struct {
+  size_t total_free_bytes;
+  size_t total_allocated_bytes;
+  size_t largest_free_block;
+  size_t minimum_free_bytes;
+  size_t allocated_blocks;
+  size_t free_blocks;
+  size_t total_blocks;
+} multi_heap_info_t;
+
+#endif /* MULTI_HEAP_H_ */
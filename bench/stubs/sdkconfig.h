@@ -0,0 +1 @@
+/* The benchmarks set CLIENTS_MAX themselves, no project options are needed */
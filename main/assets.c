@@ -0,0 +1,163 @@
+/**
+ ******************************************************************************
+ * @file           : assets.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Web assets store mapped from the flash
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+
+#include "assets.h"
+
+/* Private macros ------------------------------------------------------------*/
+#define ASSETS_MAGIC 0x5757464E /* "NFWW" */
+#define ASSETS_VERSION 2
+
+/* External variables --------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+/* Image header, generated at build time by tools/www_gen.py */
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t num;
+} assets_header_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+static bool assets_entry_valid(const assets_entry_t *entry, size_t size);
+
+/* Exported functions definitions --------------------------------------------*/
+void assets_init(assets_t *const me) {
+  me->image = NULL;
+  me->entry = NULL;
+  me->num = 0;
+}
+
+esp_err_t assets_load(assets_t *const me, const char *label) {
+  const esp_partition_t *partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+
+  if (partition == NULL) {
+    ESP_LOGE("assets", "Failed to find %s partition", label);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  /* Map the whole image, the responses are sent from the flash cache */
+  const void *ptr;
+  esp_err_t ret =
+      esp_partition_mmap(partition, 0, partition->size,
+                         ESP_PARTITION_MMAP_DATA, &ptr, &me->mmap_handle);
+
+  if (ret != ESP_OK) {
+    ESP_LOGE("assets", "Failed to map %s partition", label);
+    return ret;
+  }
+
+  const assets_header_t *header = (const assets_header_t *)ptr;
+  const assets_entry_t *entry = (const assets_entry_t *)(header + 1);
+  bool valid = header->magic == ASSETS_MAGIC &&
+               header->version == ASSETS_VERSION &&
+               sizeof(assets_header_t) +
+                       (size_t)header->num * sizeof(assets_entry_t) <=
+                   partition->size;
+
+  /* Checked once here, the lookups trust the index */
+  for (uint16_t i = 0; valid && i < header->num; i++) {
+    valid = assets_entry_valid(&entry[i], partition->size);
+  }
+
+  if (!valid) {
+    ESP_LOGE("assets", "Invalid assets image");
+    esp_partition_munmap(me->mmap_handle);
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  me->image = (const uint8_t *)ptr;
+  me->entry = entry;
+  me->num = header->num;
+
+  ESP_LOGI("assets", "%u web assets mapped", me->num);
+
+  return ESP_OK;
+}
+
+const assets_entry_t *assets_find(const assets_t *const me, const char *name,
+                                  size_t len) {
+  uint16_t low = 0, high = me->num;
+
+  if (len >= sizeof(me->entry->name)) {
+    return NULL;
+  }
+
+  /* Binary search of the sorted names, name is not null terminated */
+  while (low < high) {
+    uint16_t mid = (low + high) / 2;
+    const assets_entry_t *entry = &me->entry[mid];
+    int cmp = strncmp(entry->name, name, len);
+
+    if (cmp == 0 && entry->name[len] != '\0') {
+      cmp = 1;
+    }
+
+    if (cmp == 0) {
+      return entry;
+    } else if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return NULL;
+}
+
+const uint8_t *assets_get_data(const assets_t *const me,
+                               const assets_entry_t *entry) {
+  return me->image + entry->offset;
+}
+
+/* Private function definitions ----------------------------------------------*/
+static bool assets_entry_valid(const assets_entry_t *entry, size_t size) {
+  return memchr(entry->name, '\0', sizeof(entry->name)) != NULL &&
+         memchr(entry->type, '\0', sizeof(entry->type)) != NULL &&
+         memchr(entry->etag, '\0', sizeof(entry->etag)) != NULL &&
+         entry->offset <= size && entry->len <= size - entry->offset;
+}
+
+/***************************** END OF FILE ************************************/
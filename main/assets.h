@@ -0,0 +1,89 @@
+/**
+ ******************************************************************************
+ * @file           : assets.h
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Web assets store mapped from the flash
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef ASSETS_H_
+#define ASSETS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+/* Exported Macros -----------------------------------------------------------*/
+/* Entries flags */
+#define ASSETS_FLAG_GZIP (1 << 0)
+#define ASSETS_FLAG_REVALIDATE (1 << 1) /* Checked on each use, the pages */
+
+/* Exported typedef ----------------------------------------------------------*/
+/* Image index entry, generated at build time by tools/www_gen.py */
+typedef struct {
+  char name[24]; /* "/index.html", sorted */
+  char type[24]; /* MIME type */
+  char etag[20]; /* Quoted FNV-1a hash of the data */
+  uint32_t offset;
+  uint32_t len;
+  uint32_t flags;
+} assets_entry_t;
+
+typedef struct {
+  const uint8_t *image;
+  const assets_entry_t *entry;
+  uint16_t num;
+  esp_partition_mmap_handle_t mmap_handle;
+} assets_t;
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void assets_init(assets_t *const me);
+esp_err_t assets_load(assets_t *const me, const char *label);
+const assets_entry_t *assets_find(const assets_t *const me, const char *name,
+                                  size_t len);
+const uint8_t *assets_get_data(const assets_t *const me,
+                               const assets_entry_t *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ASSETS_H_ */
+
+/***************************** END OF FILE ************************************/
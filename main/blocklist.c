@@ -0,0 +1,313 @@
+/**
+ ******************************************************************************
+ * @file           : blocklist.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Domain blocklist mapped from flash
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+
+#include "blocklist.h"
+
+/* Private macros ------------------------------------------------------------*/
+#define BLOCKLIST_MAGIC 0x4C42464E /* "NFBL" */
+#define BLOCKLIST_VERSION 2
+#define BLOCKLIST_FNV_OFFSET 0xCBF29CE484222325ULL
+#define BLOCKLIST_FNV_PRIME 0x100000001B3ULL
+
+/* Bloom filter macros, each key sets its bits in a single cache line block */
+#define BLOCKLIST_BLOOM_BLOCK_SIZE 64
+#define BLOCKLIST_BLOOM_BLOCK_BITS (BLOCKLIST_BLOOM_BLOCK_SIZE * 8)
+#define BLOCKLIST_BLOOM_BITS_PER_KEY 10
+#define BLOCKLIST_BLOOM_PROBES 6
+
+/* External variables --------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+/* Image header, generated at build time by tools/blocklist_gen.py */
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t bucket_bits;
+  uint32_t num;
+  uint32_t reserved;
+} blocklist_header_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+static esp_err_t blocklist_bloom_build(blocklist_t *const me);
+static void blocklist_bloom_add(blocklist_t *const me, uint64_t hash);
+static bool blocklist_bloom_check(const blocklist_t *const me, uint64_t hash);
+static uint32_t *blocklist_bloom_block(const blocklist_t *const me,
+                                       uint64_t hash);
+static bool blocklist_lookup(const blocklist_t *const me, uint64_t key);
+static bool blocklist_buckets_check(const blocklist_t *const me);
+static uint64_t blocklist_hash_update(uint64_t hash, const char *data,
+                                      size_t len);
+
+/* Exported functions definitions --------------------------------------------*/
+void blocklist_init(blocklist_t *const me) {
+  me->bucket = NULL;
+  me->hash = NULL;
+  me->num = 0;
+  me->bucket_bits = 0;
+  me->bloom = NULL;
+  me->bloom_blocks = 0;
+}
+
+esp_err_t blocklist_load(blocklist_t *const me, const char *label) {
+  const esp_partition_t *partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+
+  if (partition == NULL) {
+    ESP_LOGE("blocklist", "Failed to find %s partition", label);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  /* Map the whole image, the lookups read it in place from the flash cache */
+  const void *ptr;
+  esp_err_t ret =
+      esp_partition_mmap(partition, 0, partition->size,
+                         ESP_PARTITION_MMAP_DATA, &ptr, &me->mmap_handle);
+
+  if (ret != ESP_OK) {
+    ESP_LOGE("blocklist", "Failed to map %s partition", label);
+    return ret;
+  }
+
+  const blocklist_header_t *header = (const blocklist_header_t *)ptr;
+  size_t buckets_size = 0;
+
+  /* Lookups shift the hash right by 64 - bucket_bits, so both ends of the
+   * range must be rejected before the size is computed */
+  if (header->bucket_bits > 0 && header->bucket_bits <= 16) {
+    buckets_size = ((1UL << header->bucket_bits) + 1) * sizeof(uint32_t);
+  }
+
+  /* Sizes checked by division, the hashes size overflows a size_t */
+  size_t space = partition->size - sizeof(blocklist_header_t);
+
+  if (header->magic != BLOCKLIST_MAGIC ||
+      header->version != BLOCKLIST_VERSION || buckets_size == 0 ||
+      buckets_size > space ||
+      header->num > (space - buckets_size) / sizeof(uint64_t)) {
+    ESP_LOGE("blocklist", "Invalid blocklist image");
+    esp_partition_munmap(me->mmap_handle);
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  me->bucket = (const uint32_t *)(header + 1);
+  me->hash = (const uint64_t *)((const uint8_t *)me->bucket + buckets_size);
+  me->num = header->num;
+  me->bucket_bits = header->bucket_bits;
+
+  /* The lookups trust the buckets to index the hashes, a corrupt or partly
+   * flashed image would read past the mapping */
+  if (!blocklist_buckets_check(me)) {
+    ESP_LOGE("blocklist", "Invalid blocklist buckets");
+    esp_partition_munmap(me->mmap_handle);
+    blocklist_init(me);
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  /* Build the Bloom filter that discards most of the lookups in RAM */
+  ret = blocklist_bloom_build(me);
+
+  if (ret != ESP_OK) {
+    ESP_LOGW("blocklist", "Failed to build Bloom filter, using index only");
+  }
+
+  return ESP_OK;
+}
+
+bool blocklist_contains(const blocklist_t *const me, const char *name,
+                        size_t len) {
+  if (me->num == 0) {
+    return false;
+  }
+
+  uint64_t hash = BLOCKLIST_FNV_OFFSET;
+  size_t end = len;
+
+  /* Hash the labels from the top level domain down, so every step gives the
+   * hash of one more suffix of the name in a single pass */
+  for (;;) {
+    size_t start = end;
+
+    while (start > 0 && name[start - 1] != '.') {
+      start--;
+    }
+
+    if (end != len) {
+      hash = blocklist_hash_update(hash, ".", 1);
+    }
+
+    hash = blocklist_hash_update(hash, &name[start], end - start);
+
+    /* Wildcard rules block the suffix itself and every name below it */
+    if (blocklist_lookup(me, hash | 1)) {
+      return true;
+    }
+
+    if (start == 0) {
+      return blocklist_lookup(me, hash & ~1ULL);
+    }
+
+    end = start - 1;
+  }
+}
+
+/* Private function definitions ----------------------------------------------*/
+static esp_err_t blocklist_bloom_build(blocklist_t *const me) {
+  uint32_t blocks = ((uint64_t)me->num * BLOCKLIST_BLOOM_BITS_PER_KEY +
+                     BLOCKLIST_BLOOM_BLOCK_BITS - 1) /
+                    BLOCKLIST_BLOOM_BLOCK_BITS;
+
+  /* Keep the filter in internal RAM, aligned to the cache line */
+  me->bloom = (uint32_t *)heap_caps_aligned_alloc(
+      BLOCKLIST_BLOOM_BLOCK_SIZE, blocks * BLOCKLIST_BLOOM_BLOCK_SIZE,
+      MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+  if (me->bloom == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  memset(me->bloom, 0, blocks * BLOCKLIST_BLOOM_BLOCK_SIZE);
+  me->bloom_blocks = blocks;
+
+  for (uint32_t i = 0; i < me->num; i++) {
+    blocklist_bloom_add(me, me->hash[i]);
+  }
+
+  ESP_LOGI("blocklist", "Bloom filter built with %lu bytes",
+           blocks * BLOCKLIST_BLOOM_BLOCK_SIZE);
+
+  return ESP_OK;
+}
+
+static void blocklist_bloom_add(blocklist_t *const me, uint64_t hash) {
+  uint32_t *block = blocklist_bloom_block(me, hash);
+
+  /* Each probe takes 9 bits of the hash as the bit index in the block */
+  for (uint8_t i = 0; i < BLOCKLIST_BLOOM_PROBES; i++) {
+    uint32_t bit = (hash >> (9 * i)) & (BLOCKLIST_BLOOM_BLOCK_BITS - 1);
+    block[bit >> 5] |= 1UL << (bit & 31);
+  }
+}
+
+static bool blocklist_bloom_check(const blocklist_t *const me, uint64_t hash) {
+  /* Without filter every name is a candidate */
+  if (me->bloom == NULL) {
+    return true;
+  }
+
+  const uint32_t *block = blocklist_bloom_block(me, hash);
+
+  for (uint8_t i = 0; i < BLOCKLIST_BLOOM_PROBES; i++) {
+    uint32_t bit = (hash >> (9 * i)) & (BLOCKLIST_BLOOM_BLOCK_BITS - 1);
+
+    if (!(block[bit >> 5] & (1UL << (bit & 31)))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool blocklist_lookup(const blocklist_t *const me, uint64_t key) {
+  /* Most of the keys are not blocked, discard them without touching flash */
+  if (!blocklist_bloom_check(me, key)) {
+    return false;
+  }
+
+  /* The key top bits select the bucket with the candidates */
+  uint32_t bucket = key >> (64 - me->bucket_bits);
+  uint32_t low = me->bucket[bucket];
+  uint32_t high = me->bucket[bucket + 1];
+
+  /* Binary search over the sorted keys of the bucket */
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+
+    if (me->hash[mid] < key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low < me->bucket[bucket + 1] && me->hash[low] == key;
+}
+
+static bool blocklist_buckets_check(const blocklist_t *const me) {
+  uint32_t buckets = 1UL << me->bucket_bits;
+
+  /* Non-decreasing offsets ending at the hashes count */
+  for (uint32_t i = 0; i < buckets; i++) {
+    if (me->bucket[i] > me->bucket[i + 1]) {
+      return false;
+    }
+  }
+
+  return me->bucket[buckets] == me->num;
+}
+
+static uint64_t blocklist_hash_update(uint64_t hash, const char *data,
+                                      size_t len) {
+  /* FNV-1a over the lower case data */
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)tolower((unsigned char)data[i]);
+    hash *= BLOCKLIST_FNV_PRIME;
+  }
+
+  return hash;
+}
+
+static uint32_t *blocklist_bloom_block(const blocklist_t *const me,
+                                       uint64_t hash) {
+  /* Remix the hash so the block does not depend on the probe bits, then map
+   * it to the blocks range without a division */
+  uint32_t mix = (hash * 0x9E3779B97F4A7C15ULL) >> 32;
+  uint32_t idx = ((uint64_t)mix * me->bloom_blocks) >> 32;
+
+  return &me->bloom[idx * (BLOCKLIST_BLOOM_BLOCK_SIZE / sizeof(uint32_t))];
+}
+
+/***************************** END OF FILE ************************************/
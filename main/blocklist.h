@@ -0,0 +1,78 @@
+/**
+ ******************************************************************************
+ * @file           : blocklist.h
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Blocked domains lookup
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef BLOCKLIST_H_
+#define BLOCKLIST_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+/* Exported Macros -----------------------------------------------------------*/
+
+/* Exported typedef ----------------------------------------------------------*/
+typedef struct {
+  const uint32_t *bucket;
+  const uint64_t *hash;
+  uint32_t num;
+  uint16_t bucket_bits;
+  esp_partition_mmap_handle_t mmap_handle;
+  uint32_t *bloom;
+  uint32_t bloom_blocks;
+} blocklist_t;
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void blocklist_init(blocklist_t *const me);
+esp_err_t blocklist_load(blocklist_t *const me, const char *label);
+bool blocklist_contains(const blocklist_t *const me, const char *name,
+                        size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BLOCKLIST_H_ */
+
+/***************************** END OF FILE ************************************/
@@ -39,74 +39,266 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "sdkconfig.h"
+
 /* Private macros ------------------------------------------------------------*/
+#ifndef CLIENTS_MAX
+#define CLIENTS_MAX CONFIG_LWIP_DHCPS_MAX_STATION_NUM
+#endif
+
+/* Open addressing index, kept at most half full */
+#define CLIENTS_INDEX_SIZE (CLIENTS_MAX * 2)
+
+/* Heap position of the clients without a pending deadline */
+#define CLIENTS_HEAP_NONE ((clients_pos_t)-1)
 
 /* External variables --------------------------------------------------------*/
 
 /* Private typedef -----------------------------------------------------------*/
+/* Positions fit in a byte for the station limits of the AP, wider lists are
+ * only built for the host benchmarks */
+#if CLIENTS_MAX < 0xFF
+typedef uint8_t clients_pos_t;
+#else
+typedef uint16_t clients_pos_t;
+#endif
+
 typedef struct {
   uint8_t aid;
   uint8_t mac[6];
-  uint16_t time;
+  clients_pos_t heap_pos;
+  int64_t deadline;
 } client_t;
 
 typedef struct {
-  uint8_t num;
-  client_t *client;
+  clients_pos_t num;
+  client_t client[CLIENTS_MAX];
+  clients_pos_t index[CLIENTS_INDEX_SIZE]; /* Position + 1, 0 if empty */
+  clients_pos_t heap[CLIENTS_MAX];         /* Positions by deadline */
+  clients_pos_t heap_num;
 } clients_t;
 
 /* Private variables ---------------------------------------------------------*/
 
 /* Private function prototypes -----------------------------------------------*/
+static uint16_t clients_hash(const uint8_t *mac);
+static uint16_t clients_probe(const clients_t *const me, const uint8_t *mac);
+static void clients_index_delete(clients_t *const me, uint16_t slot);
+static void clients_heap_set(clients_t *const me, clients_pos_t pos,
+                             clients_pos_t idx);
+static void clients_heap_up(clients_t *const me, clients_pos_t pos);
+static void clients_heap_down(clients_t *const me, clients_pos_t pos);
+static void clients_heap_remove(clients_t *const me, clients_pos_t idx);
 
 /* Exported functions definitions --------------------------------------------*/
 void clients_init(clients_t *const me) {
   me->num = 0;
-  me->client = NULL;
+  me->heap_num = 0;
+  memset(me->index, 0, sizeof(me->index));
 }
 
-void clients_add(clients_t *const me, uint8_t *mac, uint8_t aid, uint16_t time) {
-  /* Reallocate memory for the new client */
-  me->client =
-      (client_t *)realloc(me->client, (me->num + 1) * sizeof(client_t));
+client_t *clients_find(clients_t *const me, const uint8_t *mac) {
+  uint16_t slot = clients_probe(me, mac);
 
-  if (me->client == NULL) {
-    return;
+  return me->index[slot] ? &me->client[me->index[slot] - 1] : NULL;
+}
+
+bool clients_add(clients_t *const me, const uint8_t *mac, uint8_t aid,
+                 int64_t deadline) {
+  uint16_t slot = clients_probe(me, mac);
+  clients_pos_t idx;
+
+  if (me->index[slot]) {
+    /* Refresh the client if it is already in the list */
+    idx = me->index[slot] - 1;
+    clients_heap_remove(me, idx);
+  } else {
+    if (me->num == CLIENTS_MAX) {
+      return false;
+    }
+
+    /* Fill the new client data at the end of the list */
+    idx = me->num;
+    memcpy(me->client[idx].mac, mac, 6);
+
+    /* Increase the clients number */
+    me->index[slot] = ++me->num;
   }
 
-  /* Fill the new client data */
-  strncpy((char *)me->client[me->num].mac, (char *)mac, 6);
-  me->client[me->num].time = time;
-  me->client[me->num].aid = aid;
+  client_t *client = &me->client[idx];
+  client->aid = aid;
+  client->deadline = deadline;
+
+  /* Schedule the session expiration */
+  clients_heap_set(me, me->heap_num++, idx);
+  clients_heap_up(me, client->heap_pos);
 
-  /* Increase the clients number */
-  me->num++;
+  return true;
 }
 
-void clients_remove(clients_t *const me, uint8_t *mac) {
-  /* Search for the client with the same MAC address */
-  uint8_t idx = 0;
+bool clients_remove(clients_t *const me, const uint8_t *mac) {
+  uint16_t slot = clients_probe(me, mac);
+
+  if (!me->index[slot]) {
+    return false;
+  }
 
-  while (idx < me->num) {
-    if (!strncmp((char *)me->client[idx].mac, (char *)mac, 6)) {
-      /* Shift the clients after the removed index */
-      for (uint8_t i = idx; i < me->num - 1; i++) {
-        me->client[i] = me->client[i + 1];
-      }
+  clients_pos_t idx = me->index[slot] - 1;
+  clients_pos_t last = me->num - 1;
 
-      /* Reduce the clients number */
-      me->num--;
+  clients_index_delete(me, slot);
+  clients_heap_remove(me, idx);
 
-      /* Reallocate memory */
-      me->client = (client_t *)realloc(me->client, me->num * sizeof(client_t));
+  /* Move the last client to the free position to keep the list packed */
+  if (idx != last) {
+    me->index[clients_probe(me, me->client[last].mac)] = idx + 1;
+    me->client[idx] = me->client[last];
 
-      return;
+    if (me->client[idx].heap_pos != CLIENTS_HEAP_NONE) {
+      me->heap[me->client[idx].heap_pos] = idx;
     }
+  }
+
+  /* Reduce the clients number */
+  me->num--;
+
+  return true;
+}
 
-    idx++;
+int64_t clients_next_deadline(const clients_t *const me) {
+  return me->heap_num ? me->client[me->heap[0]].deadline : INT64_MAX;
+}
+
+client_t *clients_pop_expired(clients_t *const me, int64_t now) {
+  if (me->heap_num == 0 || me->client[me->heap[0]].deadline > now) {
+    return NULL;
   }
+
+  /* The client stays in the list until it disconnects, only its deadline is
+   * consumed */
+  clients_pos_t idx = me->heap[0];
+  clients_heap_remove(me, idx);
+
+  return &me->client[idx];
 }
 
 /* Private function definitions ----------------------------------------------*/
+static uint16_t clients_hash(const uint8_t *mac) {
+  /* The vendor part of the MAC is shared by many clients, use the rest */
+  uint32_t key = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) |
+                 ((uint32_t)mac[4] << 8) | mac[5];
+
+  return (uint32_t)(key * 0x9E3779B1UL) % CLIENTS_INDEX_SIZE;
+}
+
+static uint16_t clients_probe(const clients_t *const me, const uint8_t *mac) {
+  uint16_t slot = clients_hash(mac);
+
+  /* Linear probing until the client or an empty slot is found */
+  while (me->index[slot] &&
+         memcmp(me->client[me->index[slot] - 1].mac, mac, 6)) {
+    if (++slot == CLIENTS_INDEX_SIZE) {
+      slot = 0;
+    }
+  }
+
+  return slot;
+}
+
+static void clients_index_delete(clients_t *const me, uint16_t slot) {
+  uint16_t next = slot;
+
+  /* Shift back the entries of the probe sequence, so the lookups never need
+   * tombstones */
+  for (;;) {
+    if (++next == CLIENTS_INDEX_SIZE) {
+      next = 0;
+    }
+
+    if (!me->index[next]) {
+      break;
+    }
+
+    uint16_t home = clients_hash(me->client[me->index[next] - 1].mac);
+
+    /* Move the entry when its home slot is not between the hole and it */
+    bool in_range = slot <= next ? (slot < home && home <= next)
+                                 : (slot < home || home <= next);
+
+    if (!in_range) {
+      me->index[slot] = me->index[next];
+      slot = next;
+    }
+  }
+
+  me->index[slot] = 0;
+}
+
+static void clients_heap_set(clients_t *const me, clients_pos_t pos,
+                             clients_pos_t idx) {
+  me->heap[pos] = idx;
+  me->client[idx].heap_pos = pos;
+}
+
+static void clients_heap_up(clients_t *const me, clients_pos_t pos) {
+  clients_pos_t idx = me->heap[pos];
+
+  while (pos > 0) {
+    clients_pos_t parent = (pos - 1) / 2;
+
+    if (me->client[me->heap[parent]].deadline <= me->client[idx].deadline) {
+      break;
+    }
+
+    clients_heap_set(me, pos, me->heap[parent]);
+    pos = parent;
+  }
+
+  clients_heap_set(me, pos, idx);
+}
+
+static void clients_heap_down(clients_t *const me, clients_pos_t pos) {
+  clients_pos_t idx = me->heap[pos];
+
+  for (;;) {
+    uint32_t child = 2 * (uint32_t)pos + 1;
+
+    if (child >= me->heap_num) {
+      break;
+    }
+
+    if (child + 1 < me->heap_num &&
+        me->client[me->heap[child + 1]].deadline <
+            me->client[me->heap[child]].deadline) {
+      child++;
+    }
+
+    if (me->client[idx].deadline <= me->client[me->heap[child]].deadline) {
+      break;
+    }
+
+    clients_heap_set(me, pos, me->heap[child]);
+    pos = child;
+  }
+
+  clients_heap_set(me, pos, idx);
+}
+
+static void clients_heap_remove(clients_t *const me, clients_pos_t idx) {
+  clients_pos_t pos = me->client[idx].heap_pos;
+
+  if (pos == CLIENTS_HEAP_NONE) {
+    return;
+  }
+
+  me->client[idx].heap_pos = CLIENTS_HEAP_NONE;
+
+  /* Fill the hole with the last entry and restore the heap order */
+  if (pos != --me->heap_num) {
+    clients_heap_set(me, pos, me->heap[me->heap_num]);
+    clients_heap_up(me, pos);
+    clients_heap_down(me, me->client[me->heap[pos]].heap_pos);
+  }
+}
 
 /***************************** END OF FILE ************************************/
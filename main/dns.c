@@ -0,0 +1,511 @@
+/**
+ ******************************************************************************
+ * @file           : dns.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : DNS forwarder with domain blocking for the AP clients
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#include "blocklist.h"
+#include "dns_cache.h"
+
+/* Private macros ------------------------------------------------------------*/
+#define DNS_PORT 53
+#define DNS_BUF_SIZE 1472
+#define DNS_HEADER_SIZE 12
+#define DNS_NAME_MAX 255
+#define DNS_PENDING_MAX 64 /* Must be a power of two */
+#define DNS_UPSTREAM_MAX 4
+#define DNS_UPSTREAM_RACE 2 /* Upstreams queried in parallel */
+#define DNS_UPSTREAM_TIMEOUT_US 3000000
+#define DNS_UPSTREAM_EWMA_SHIFT 3 /* Smoothing factor of 1/8 */
+#define DNS_UPSTREAM_PENALTY_MAX 8
+#define DNS_BLOCKED_TTL 300
+
+#define DNS_TYPE_A 1
+#define DNS_RCODE_NXDOMAIN 3
+
+/* External variables --------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  struct sockaddr_in addr;
+  uint32_t ewma_us;
+  uint32_t queries;
+  uint32_t answers;
+  uint32_t wins;
+  uint32_t failures;
+  uint8_t failures_in_row;
+} dns_upstream_t;
+
+typedef struct {
+  bool used;
+  bool answered;
+  uint8_t waiting; /* Mask of the upstreams without answer yet */
+  uint16_t id;
+  uint16_t client_id;
+  struct sockaddr_in client;
+  int64_t time;
+} dns_pending_t;
+
+typedef struct {
+  int server_sock;
+  int upstream_sock;
+  dns_upstream_t upstream[DNS_UPSTREAM_MAX];
+  uint8_t upstream_num;
+  blocklist_t *blocklist;
+  dns_cache_t *cache;
+  dns_pending_t pending[DNS_PENDING_MAX];
+  uint8_t buf[DNS_BUF_SIZE];
+  uint32_t blocked;
+  uint32_t forwarded;
+} dns_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+static void dns_handle_query(dns_t *const me);
+static void dns_handle_answer(dns_t *const me);
+static void dns_expire_pending(dns_t *const me);
+static uint8_t dns_upstream_select(dns_t *const me);
+static uint32_t dns_upstream_score(const dns_upstream_t *upstream);
+static int dns_upstream_find(dns_t *const me, const struct sockaddr_in *addr);
+static int dns_parse_question(const uint8_t *pkt, size_t len, char *name,
+                              uint16_t *qtype, size_t *qend);
+static size_t dns_build_blocked(uint8_t *pkt, size_t qend, uint16_t qtype);
+static uint32_t dns_now(void);
+
+/* Exported functions definitions --------------------------------------------*/
+esp_err_t dns_init(dns_t *const me, const char *server_ip,
+                   const char *upstreams, blocklist_t *blocklist,
+                   dns_cache_t *cache) {
+  ESP_LOGI("dns", "Initializing DNS forwarder...");
+
+  memset(me->pending, 0, sizeof(me->pending));
+  me->blocklist = blocklist;
+  me->cache = cache;
+  me->blocked = 0;
+  me->forwarded = 0;
+
+  /* Fill the upstream resolvers addresses from the comma separated list */
+  char list[DNS_UPSTREAM_MAX * 16];
+  char *save = NULL;
+
+  memset(me->upstream, 0, sizeof(me->upstream));
+  me->upstream_num = 0;
+  strlcpy(list, upstreams, sizeof(list));
+
+  for (char *ip = strtok_r(list, ", ", &save);
+       ip != NULL && me->upstream_num < DNS_UPSTREAM_MAX;
+       ip = strtok_r(NULL, ", ", &save)) {
+    dns_upstream_t *upstream = &me->upstream[me->upstream_num++];
+    upstream->addr.sin_family = AF_INET;
+    upstream->addr.sin_port = htons(DNS_PORT);
+    upstream->addr.sin_addr.s_addr = ipaddr_addr(ip);
+  }
+
+  if (me->upstream_num == 0) {
+    ESP_LOGE("dns", "No upstream resolvers");
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  /* Create and bind the socket where the clients send their queries */
+  me->server_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+  if (me->server_sock < 0) {
+    ESP_LOGE("dns", "Failed to create server socket");
+    return ESP_FAIL;
+  }
+
+  struct sockaddr_in addr = {0};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(DNS_PORT);
+  addr.sin_addr.s_addr = ipaddr_addr(server_ip);
+
+  if (bind(me->server_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    ESP_LOGE("dns", "Failed to bind server socket");
+    close(me->server_sock);
+    return ESP_FAIL;
+  }
+
+  /* Create the socket used to talk with the upstream resolver */
+  me->upstream_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+  if (me->upstream_sock < 0) {
+    ESP_LOGE("dns", "Failed to create upstream socket");
+    close(me->server_sock);
+    return ESP_FAIL;
+  }
+
+  ESP_LOGI("dns", "DNS forwarder listening on %s, upstreams %s", server_ip,
+           upstreams);
+
+  return ESP_OK;
+}
+
+void dns_poll(dns_t *const me, uint32_t timeout_ms) {
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(me->server_sock, &fds);
+  FD_SET(me->upstream_sock, &fds);
+
+  struct timeval timeout = {.tv_sec = timeout_ms / 1000,
+                            .tv_usec = (timeout_ms % 1000) * 1000};
+  int max_sock = me->server_sock > me->upstream_sock ? me->server_sock
+                                                       : me->upstream_sock;
+
+  if (select(max_sock + 1, &fds, NULL, NULL, &timeout) > 0) {
+    if (FD_ISSET(me->upstream_sock, &fds)) {
+      dns_handle_answer(me);
+    }
+
+    if (FD_ISSET(me->server_sock, &fds)) {
+      dns_handle_query(me);
+    }
+  }
+
+  dns_expire_pending(me);
+}
+
+const dns_upstream_t *dns_get_upstream(dns_t *const me, uint8_t idx) {
+  return idx < me->upstream_num ? &me->upstream[idx] : NULL;
+}
+
+/* Private function definitions ----------------------------------------------*/
+static void dns_handle_query(dns_t *const me) {
+  struct sockaddr_in client;
+  socklen_t client_len = sizeof(client);
+  int len = recvfrom(me->server_sock, me->buf, sizeof(me->buf), 0,
+                     (struct sockaddr *)&client, &client_len);
+
+  /* Drop packets too short or that are not a query */
+  if (len < DNS_HEADER_SIZE || (me->buf[2] & 0x80)) {
+    return;
+  }
+
+  /* Answer right away the queries for blocked names */
+  char name[DNS_NAME_MAX + 1];
+  uint16_t qtype;
+  size_t qend;
+  int name_len = dns_parse_question(me->buf, len, name, &qtype, &qend);
+
+  if (name_len > 0 && blocklist_contains(me->blocklist, name, name_len)) {
+    size_t resp_len = dns_build_blocked(me->buf, qend, qtype);
+    sendto(me->server_sock, me->buf, resp_len, 0, (struct sockaddr *)&client,
+           client_len);
+    me->blocked++;
+    ESP_LOGD("dns", "Blocked %s", name);
+    return;
+  }
+
+  /* Answer from the cache while the response is fresh */
+  size_t resp_len;
+
+  if (name_len >= 0 && me->cache != NULL &&
+      dns_cache_get(me->cache, me->buf, sizeof(me->buf), qend, dns_now(),
+                    &resp_len)) {
+    sendto(me->server_sock, me->buf, resp_len, 0, (struct sockaddr *)&client,
+           client_len);
+    return;
+  }
+
+  /* Look for a free slot to track the query */
+  uint8_t slot;
+
+  for (slot = 0; slot < DNS_PENDING_MAX; slot++) {
+    if (!me->pending[slot].used) {
+      break;
+    }
+  }
+
+  if (slot == DNS_PENDING_MAX) {
+    ESP_LOGW("dns", "Too many pending queries");
+    return;
+  }
+
+  /* Replace the client ID with a random one that encodes the slot */
+  dns_pending_t *pending = &me->pending[slot];
+  pending->used = true;
+  pending->answered = false;
+  pending->client_id = (me->buf[0] << 8) | me->buf[1];
+  pending->id = (esp_random() & ~(DNS_PENDING_MAX - 1) & 0xFFFF) | slot;
+  pending->client = client;
+  pending->time = esp_timer_get_time();
+  pending->waiting = dns_upstream_select(me);
+
+  me->buf[0] = pending->id >> 8;
+  me->buf[1] = pending->id & 0xFF;
+
+  /* Race the query between the best upstreams, the first answer wins */
+  for (uint8_t i = 0; i < me->upstream_num; i++) {
+    if (pending->waiting & (1 << i)) {
+      sendto(me->upstream_sock, me->buf, len, 0,
+             (struct sockaddr *)&me->upstream[i].addr,
+             sizeof(me->upstream[i].addr));
+      me->upstream[i].queries++;
+    }
+  }
+
+  me->forwarded++;
+}
+
+static void dns_handle_answer(dns_t *const me) {
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof(from);
+  int len = recvfrom(me->upstream_sock, me->buf, sizeof(me->buf), 0,
+                     (struct sockaddr *)&from, &from_len);
+
+  int idx = dns_upstream_find(me, &from);
+
+  if (len < DNS_HEADER_SIZE || idx < 0) {
+    return;
+  }
+
+  /* Match the answer with the pending query */
+  uint16_t id = (me->buf[0] << 8) | me->buf[1];
+  dns_pending_t *pending = &me->pending[id & (DNS_PENDING_MAX - 1)];
+
+  if (!pending->used || pending->id != id || !(pending->waiting & (1 << idx))) {
+    return;
+  }
+
+  /* Update the upstream latency average */
+  dns_upstream_t *upstream = &me->upstream[idx];
+  int32_t latency = esp_timer_get_time() - pending->time;
+
+  if (upstream->answers == 0) {
+    upstream->ewma_us = latency;
+  } else {
+    upstream->ewma_us +=
+        (latency - (int32_t)upstream->ewma_us) >> DNS_UPSTREAM_EWMA_SHIFT;
+  }
+
+  upstream->answers++;
+  upstream->failures_in_row = 0;
+  pending->waiting &= ~(1 << idx);
+
+  /* The slot is kept until all the raced upstreams answer to measure them,
+   * but only the first answer goes to the client */
+  if (pending->answered) {
+    pending->used = pending->waiting != 0;
+    return;
+  }
+
+  pending->answered = true;
+  upstream->wins++;
+
+  /* Keep a copy of the response for the next queries of the same name */
+  char name[DNS_NAME_MAX + 1];
+  uint16_t qtype;
+  size_t qend;
+
+  if (me->cache != NULL &&
+      dns_parse_question(me->buf, len, name, &qtype, &qend) >= 0) {
+    dns_cache_put(me->cache, me->buf, len, qend, dns_now());
+  }
+
+  /* Restore the client ID and relay the answer */
+  me->buf[0] = pending->client_id >> 8;
+  me->buf[1] = pending->client_id & 0xFF;
+
+  sendto(me->server_sock, me->buf, len, 0, (struct sockaddr *)&pending->client,
+         sizeof(pending->client));
+  pending->used = pending->waiting != 0;
+}
+
+static void dns_expire_pending(dns_t *const me) {
+  int64_t now = esp_timer_get_time();
+
+  for (uint8_t i = 0; i < DNS_PENDING_MAX; i++) {
+    dns_pending_t *pending = &me->pending[i];
+
+    if (!pending->used || now - pending->time < DNS_UPSTREAM_TIMEOUT_US) {
+      continue;
+    }
+
+    /* Count a failure for every upstream that did not answer in time */
+    for (uint8_t j = 0; j < me->upstream_num; j++) {
+      if (pending->waiting & (1 << j)) {
+        me->upstream[j].failures++;
+
+        if (me->upstream[j].failures_in_row < DNS_UPSTREAM_PENALTY_MAX) {
+          me->upstream[j].failures_in_row++;
+        }
+      }
+    }
+
+    pending->used = false;
+  }
+}
+
+static uint8_t dns_upstream_select(dns_t *const me) {
+  uint8_t best[DNS_UPSTREAM_RACE];
+  uint8_t num = 0;
+
+  /* Keep the upstreams with the lowest score, sorted by insertion */
+  for (uint8_t i = 0; i < me->upstream_num; i++) {
+    uint32_t score = dns_upstream_score(&me->upstream[i]);
+    uint8_t pos = num < DNS_UPSTREAM_RACE ? num++ : DNS_UPSTREAM_RACE;
+
+    while (pos > 0 && score < dns_upstream_score(&me->upstream[best[pos - 1]])) {
+      if (pos < DNS_UPSTREAM_RACE) {
+        best[pos] = best[pos - 1];
+      }
+
+      pos--;
+    }
+
+    if (pos < DNS_UPSTREAM_RACE) {
+      best[pos] = i;
+    }
+  }
+
+  uint8_t mask = 0;
+
+  for (uint8_t i = 0; i < num; i++) {
+    mask |= 1 << best[i];
+  }
+
+  return mask;
+}
+
+static uint32_t dns_upstream_score(const dns_upstream_t *upstream) {
+  /* Upstreams not measured yet are tried first, every consecutive failure
+   * doubles the latency that the upstream is judged by */
+  if (upstream->answers == 0 && upstream->failures == 0) {
+    return 0;
+  }
+
+  uint32_t ewma_us = upstream->ewma_us ? upstream->ewma_us : 1;
+
+  if (upstream->answers == 0) {
+    ewma_us = DNS_UPSTREAM_TIMEOUT_US;
+  }
+
+  return ewma_us << upstream->failures_in_row;
+}
+
+static int dns_upstream_find(dns_t *const me, const struct sockaddr_in *addr) {
+  for (uint8_t i = 0; i < me->upstream_num; i++) {
+    if (me->upstream[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+        me->upstream[i].addr.sin_port == addr->sin_port) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static int dns_parse_question(const uint8_t *pkt, size_t len, char *name,
+                              uint16_t *qtype, size_t *qend) {
+  /* Only standard queries with a single question are inspected */
+  if ((pkt[2] & 0x78) != 0 || pkt[4] != 0 || pkt[5] != 1) {
+    return -1;
+  }
+
+  size_t pos = DNS_HEADER_SIZE;
+  int name_len = 0;
+
+  /* Convert the labels to a dotted lower case name */
+  while (pos < len && pkt[pos] != 0) {
+    uint8_t label_len = pkt[pos++];
+
+    if (label_len > 63 || pos + label_len > len ||
+        name_len + label_len + 1 > DNS_NAME_MAX) {
+      return -1;
+    }
+
+    if (name_len > 0) {
+      name[name_len++] = '.';
+    }
+
+    for (uint8_t i = 0; i < label_len; i++) {
+      name[name_len++] = tolower(pkt[pos++]);
+    }
+  }
+
+  /* Skip the root label and read the type and class */
+  if (pos + 5 > len) {
+    return -1;
+  }
+
+  name[name_len] = '\0';
+  *qtype = (pkt[pos + 1] << 8) | pkt[pos + 2];
+  *qend = pos + 5;
+
+  return name_len;
+}
+
+static size_t dns_build_blocked(uint8_t *pkt, size_t qend, uint16_t qtype) {
+  /* Keep the opcode and RD bits, set QR and RA */
+  pkt[2] = 0x80 | (pkt[2] & 0x79);
+  pkt[3] = 0x80 | DNS_RCODE_NXDOMAIN;
+
+  /* Answer with 0.0.0.0 to A queries and NXDOMAIN to the rest */
+  memset(&pkt[6], 0, 6);
+
+  if (qtype != DNS_TYPE_A || qend + 16 > DNS_BUF_SIZE) {
+    return qend;
+  }
+
+  pkt[7] = 1;
+
+  const uint8_t answer[] = {
+      0xC0, 0x0C,                         /* Pointer to the question name */
+      0x00, DNS_TYPE_A, 0x00, 0x01,       /* Type A, class IN */
+      0x00, 0x00, DNS_BLOCKED_TTL >> 8,   /* TTL */
+      DNS_BLOCKED_TTL & 0xFF, 0x00, 0x04, /* Data length */
+      0x00, 0x00, 0x00, 0x00              /* 0.0.0.0 */
+  };
+
+  pkt[3] = 0x80;
+  memcpy(&pkt[qend], answer, sizeof(answer));
+
+  return qend + sizeof(answer);
+}
+
+static uint32_t dns_now(void) { return esp_timer_get_time() / 1000000; }
+
+/***************************** END OF FILE ************************************/
@@ -0,0 +1,393 @@
+/**
+ ******************************************************************************
+ * @file           : dns_cache.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : TTL aware LRU cache of DNS responses
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "dns_cache.h"
+
+/* Private macros ------------------------------------------------------------*/
+#define DNS_CACHE_NONE 0xFFFF
+#define DNS_CACHE_TTL_MAX 86400
+#define DNS_CACHE_NEGATIVE_TTL 60
+
+#define DNS_CACHE_TYPE_SOA 6
+#define DNS_CACHE_TYPE_OPT 41
+
+#define DNS_CACHE_FNV_OFFSET 0xCBF29CE484222325ULL
+#define DNS_CACHE_FNV_PRIME 0x100000001B3ULL
+
+/* External variables --------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t dns_cache_key(const uint8_t *pkt, size_t qend);
+static uint16_t dns_cache_find(dns_cache_t *const me, uint64_t key,
+                               const uint8_t *pkt, size_t qend);
+static bool dns_cache_question_equal(const uint8_t *a, const uint8_t *b,
+                                     size_t qend);
+static void dns_cache_unlink(dns_cache_t *const me, uint16_t idx);
+static void dns_cache_push_front(dns_cache_t *const me, uint16_t idx);
+static void dns_cache_remove(dns_cache_t *const me, uint16_t idx);
+static bool dns_cache_ttl(uint8_t *pkt, size_t len, size_t qend,
+                          uint32_t elapsed, uint32_t *ttl);
+static int dns_cache_skip_name(const uint8_t *pkt, size_t len, size_t pos);
+
+/* Exported functions definitions --------------------------------------------*/
+esp_err_t dns_cache_init(dns_cache_t *const me, size_t budget) {
+  me->num = budget / sizeof(dns_cache_entry_t);
+  me->hits = 0;
+  me->misses = 0;
+
+  if (me->num == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if (me->num >= DNS_CACHE_NONE) {
+    me->num = DNS_CACHE_NONE - 1;
+  }
+
+  /* Two buckets per entry at least, rounded to a power of two */
+  for (me->buckets = 1; me->buckets < 2 * me->num; me->buckets <<= 1) {
+  }
+
+  /* The entries go to PSRAM when available, the buckets to internal RAM */
+  me->entry = (dns_cache_entry_t *)heap_caps_calloc(
+      me->num, sizeof(dns_cache_entry_t), MALLOC_CAP_SPIRAM);
+
+  if (me->entry == NULL) {
+    me->entry = (dns_cache_entry_t *)heap_caps_calloc(
+        me->num, sizeof(dns_cache_entry_t), MALLOC_CAP_DEFAULT);
+  }
+
+  me->bucket = (uint16_t *)heap_caps_malloc(
+      me->buckets * sizeof(uint16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+  if (me->entry == NULL || me->bucket == NULL) {
+    heap_caps_free(me->entry);
+    heap_caps_free(me->bucket);
+    return ESP_ERR_NO_MEM;
+  }
+
+  memset(me->bucket, 0xFF, me->buckets * sizeof(uint16_t));
+
+  /* All the entries start in the free list */
+  me->head = DNS_CACHE_NONE;
+  me->tail = DNS_CACHE_NONE;
+  me->free = 0;
+
+  for (uint16_t i = 0; i < me->num; i++) {
+    me->entry[i].next = i + 1 < me->num ? i + 1 : DNS_CACHE_NONE;
+  }
+
+  ESP_LOGI("dns_cache", "DNS cache initialized with %u entries", me->num);
+
+  return ESP_OK;
+}
+
+bool dns_cache_get(dns_cache_t *const me, uint8_t *pkt, size_t size,
+                   size_t qend, uint32_t now, size_t *len) {
+  uint64_t key = dns_cache_key(pkt, qend);
+  uint16_t idx = dns_cache_find(me, key, pkt, qend);
+
+  if (idx == DNS_CACHE_NONE) {
+    me->misses++;
+    return false;
+  }
+
+  dns_cache_entry_t *entry = &me->entry[idx];
+
+  /* Expired entries are released on the first access after the TTL */
+  if ((int32_t)(now - entry->expire) >= 0) {
+    dns_cache_remove(me, idx);
+    me->misses++;
+    return false;
+  }
+
+  if (entry->len > size) {
+    me->misses++;
+    return false;
+  }
+
+  /* Copy the response keeping the query ID and age its TTLs */
+  memcpy(&pkt[2], &entry->data[2], entry->len - 2);
+  dns_cache_ttl(pkt, entry->len, entry->qend, now - entry->time, NULL);
+  *len = entry->len;
+
+  /* Move the entry to the most recently used position */
+  dns_cache_unlink(me, idx);
+  dns_cache_push_front(me, idx);
+  me->hits++;
+
+  return true;
+}
+
+void dns_cache_put(dns_cache_t *const me, const uint8_t *pkt, size_t len,
+                   size_t qend, uint32_t now) {
+  uint8_t rcode = pkt[3] & 0x0F;
+  uint32_t ttl = UINT32_MAX;
+
+  /* Only answers and negative responses (NXDOMAIN or no data) are cached,
+   * truncated responses are not */
+  if (len > DNS_CACHE_DATA_MAX || (pkt[2] & 0x02) ||
+      (rcode != 0 && rcode != 3)) {
+    return;
+  }
+
+  if (!dns_cache_ttl((uint8_t *)pkt, len, qend, 0, &ttl)) {
+    return;
+  }
+
+  /* Negative responses without SOA record get a fixed TTL */
+  if (ttl == UINT32_MAX) {
+    ttl = DNS_CACHE_NEGATIVE_TTL;
+  }
+
+  if (ttl > DNS_CACHE_TTL_MAX) {
+    ttl = DNS_CACHE_TTL_MAX;
+  }
+
+  if (ttl == 0) {
+    return;
+  }
+
+  /* Replace the previous response of the same question, if any */
+  uint64_t key = dns_cache_key(pkt, qend);
+  uint16_t idx = dns_cache_find(me, key, pkt, qend);
+
+  if (idx != DNS_CACHE_NONE) {
+    dns_cache_remove(me, idx);
+  }
+
+  /* Take a free entry or evict the least recently used one */
+  if (me->free == DNS_CACHE_NONE) {
+    dns_cache_remove(me, me->tail);
+  }
+
+  idx = me->free;
+  dns_cache_entry_t *entry = &me->entry[idx];
+  me->free = entry->next;
+
+  entry->key = key;
+  entry->time = now;
+  entry->expire = now + ttl;
+  entry->qend = qend;
+  entry->len = len;
+  memcpy(entry->data, pkt, len);
+
+  uint16_t *bucket = &me->bucket[key & (me->buckets - 1)];
+  entry->chain = *bucket;
+  *bucket = idx;
+
+  dns_cache_push_front(me, idx);
+}
+
+/* Private function definitions ----------------------------------------------*/
+static uint64_t dns_cache_key(const uint8_t *pkt, size_t qend) {
+  uint64_t hash = DNS_CACHE_FNV_OFFSET;
+
+  /* The name is case insensitive, the type and class are not */
+  for (size_t i = 12; i < qend; i++) {
+    hash ^= i < qend - 4 ? (uint8_t)tolower(pkt[i]) : pkt[i];
+    hash *= DNS_CACHE_FNV_PRIME;
+  }
+
+  return hash;
+}
+
+static uint16_t dns_cache_find(dns_cache_t *const me, uint64_t key,
+                               const uint8_t *pkt, size_t qend) {
+  uint16_t idx = me->bucket[key & (me->buckets - 1)];
+
+  while (idx != DNS_CACHE_NONE) {
+    dns_cache_entry_t *entry = &me->entry[idx];
+
+    if (entry->key == key && entry->qend == qend &&
+        dns_cache_question_equal(entry->data, pkt, qend)) {
+      return idx;
+    }
+
+    idx = entry->chain;
+  }
+
+  return DNS_CACHE_NONE;
+}
+
+static bool dns_cache_question_equal(const uint8_t *a, const uint8_t *b,
+                                     size_t qend) {
+  /* The name is case insensitive, the type and class are not */
+  for (size_t i = 12; i < qend - 4; i++) {
+    if (tolower(a[i]) != tolower(b[i])) {
+      return false;
+    }
+  }
+
+  return !memcmp(&a[qend - 4], &b[qend - 4], 4);
+}
+
+static void dns_cache_unlink(dns_cache_t *const me, uint16_t idx) {
+  dns_cache_entry_t *entry = &me->entry[idx];
+
+  if (entry->prev != DNS_CACHE_NONE) {
+    me->entry[entry->prev].next = entry->next;
+  } else {
+    me->head = entry->next;
+  }
+
+  if (entry->next != DNS_CACHE_NONE) {
+    me->entry[entry->next].prev = entry->prev;
+  } else {
+    me->tail = entry->prev;
+  }
+}
+
+static void dns_cache_push_front(dns_cache_t *const me, uint16_t idx) {
+  dns_cache_entry_t *entry = &me->entry[idx];
+
+  entry->prev = DNS_CACHE_NONE;
+  entry->next = me->head;
+
+  if (me->head != DNS_CACHE_NONE) {
+    me->entry[me->head].prev = idx;
+  } else {
+    me->tail = idx;
+  }
+
+  me->head = idx;
+}
+
+static void dns_cache_remove(dns_cache_t *const me, uint16_t idx) {
+  dns_cache_entry_t *entry = &me->entry[idx];
+
+  /* Unlink the entry from its hash chain */
+  uint16_t *link = &me->bucket[entry->key & (me->buckets - 1)];
+
+  while (*link != idx) {
+    link = &me->entry[*link].chain;
+  }
+
+  *link = entry->chain;
+
+  /* Unlink it from the LRU list and give it back to the free list */
+  dns_cache_unlink(me, idx);
+  entry->next = me->free;
+  me->free = idx;
+}
+
+static bool dns_cache_ttl(uint8_t *pkt, size_t len, size_t qend,
+                          uint32_t elapsed, uint32_t *ttl) {
+  uint16_t count = ((pkt[6] << 8) | pkt[7]) + ((pkt[8] << 8) | pkt[9]) +
+                   ((pkt[10] << 8) | pkt[11]);
+  int pos = qend;
+
+  /* Walk the answer, authority and additional records */
+  for (uint16_t i = 0; i < count; i++) {
+    pos = dns_cache_skip_name(pkt, len, pos);
+
+    if (pos < 0 || (size_t)pos + 10 > len) {
+      return false;
+    }
+
+    uint16_t type = (pkt[pos] << 8) | pkt[pos + 1];
+    uint32_t rr_ttl = ((uint32_t)pkt[pos + 4] << 24) | (pkt[pos + 5] << 16) |
+                      (pkt[pos + 6] << 8) | pkt[pos + 7];
+    uint16_t rdlen = (pkt[pos + 8] << 8) | pkt[pos + 9];
+
+    if ((size_t)pos + 10 + rdlen > len) {
+      return false;
+    }
+
+    /* The OPT pseudo record uses the TTL field for flags */
+    if (type != DNS_CACHE_TYPE_OPT) {
+      if (ttl != NULL) {
+        *ttl = rr_ttl < *ttl ? rr_ttl : *ttl;
+
+        /* Negative answers live as long as the SOA minimum field */
+        if (type == DNS_CACHE_TYPE_SOA && rdlen >= 4) {
+          const uint8_t *min = &pkt[pos + 10 + rdlen - 4];
+          uint32_t soa_min = ((uint32_t)min[0] << 24) | (min[1] << 16) |
+                             (min[2] << 8) | min[3];
+          *ttl = soa_min < *ttl ? soa_min : *ttl;
+        }
+      }
+
+      if (elapsed > 0) {
+        rr_ttl = rr_ttl > elapsed ? rr_ttl - elapsed : 0;
+        pkt[pos + 4] = rr_ttl >> 24;
+        pkt[pos + 5] = rr_ttl >> 16;
+        pkt[pos + 6] = rr_ttl >> 8;
+        pkt[pos + 7] = rr_ttl;
+      }
+    }
+
+    pos += 10 + rdlen;
+  }
+
+  return true;
+}
+
+static int dns_cache_skip_name(const uint8_t *pkt, size_t len, size_t pos) {
+  while (pos < len) {
+    uint8_t label_len = pkt[pos];
+
+    if (label_len == 0) {
+      return pos + 1;
+    }
+
+    /* A compression pointer ends the name */
+    if ((label_len & 0xC0) == 0xC0) {
+      return pos + 2;
+    }
+
+    if (label_len & 0xC0) {
+      return -1;
+    }
+
+    pos += label_len + 1;
+  }
+
+  return -1;
+}
+
+/***************************** END OF FILE ************************************/
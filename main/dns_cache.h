@@ -0,0 +1,93 @@
+/**
+ ******************************************************************************
+ * @file           : dns_cache.h
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : DNS responses cache
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef DNS_CACHE_H_
+#define DNS_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/* Exported Macros -----------------------------------------------------------*/
+#define DNS_CACHE_DATA_MAX 512 /* Bigger responses are not cached */
+
+/* Exported typedef ----------------------------------------------------------*/
+typedef struct {
+  uint64_t key;
+  uint32_t time;
+  uint32_t expire;
+  uint16_t prev;
+  uint16_t next;
+  uint16_t chain;
+  uint16_t qend;
+  uint16_t len;
+  uint8_t data[DNS_CACHE_DATA_MAX];
+} dns_cache_entry_t;
+
+typedef struct {
+  dns_cache_entry_t *entry;
+  uint16_t *bucket;
+  uint16_t num;
+  uint16_t buckets;
+  uint16_t head; /* Most recently used */
+  uint16_t tail; /* Least recently used */
+  uint16_t free;
+  uint32_t hits;
+  uint32_t misses;
+} dns_cache_t;
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+esp_err_t dns_cache_init(dns_cache_t *const me, size_t budget);
+bool dns_cache_get(dns_cache_t *const me, uint8_t *pkt, size_t size,
+                   size_t qend, uint32_t now, size_t *len);
+void dns_cache_put(dns_cache_t *const me, const uint8_t *pkt, size_t len,
+                   size_t qend, uint32_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DNS_CACHE_H_ */
+
+/***************************** END OF FILE ************************************/
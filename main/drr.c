@@ -0,0 +1,180 @@
+/**
+ ******************************************************************************
+ * @file           : drr.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Deficit round robin queues of frames, one per client
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "lwip/pbuf.h"
+
+#include "drr.h"
+
+/* Private macros ------------------------------------------------------------*/
+
+/* External variables --------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+static struct pbuf *drr_pop(drr_t *const me, uint8_t id);
+
+/* Exported functions definitions --------------------------------------------*/
+esp_err_t drr_init(drr_t *const me, uint16_t depth, uint32_t limit,
+                   uint16_t quantum) {
+  memset(me, 0, sizeof(drr_t));
+
+  if (depth == 0 || quantum == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  me->depth = depth;
+  me->limit = limit;
+  me->quantum = quantum;
+
+  /* Only the frames pointers are stored, in PSRAM when available */
+  me->frame = (struct pbuf **)heap_caps_calloc(
+      DRR_FLOWS * depth, sizeof(struct pbuf *), MALLOC_CAP_SPIRAM);
+
+  if (me->frame == NULL) {
+    me->frame = (struct pbuf **)heap_caps_calloc(
+        DRR_FLOWS * depth, sizeof(struct pbuf *), MALLOC_CAP_DEFAULT);
+  }
+
+  if (me->frame == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  return ESP_OK;
+}
+
+bool drr_empty(const drr_t *const me) { return me->bytes == 0; }
+
+bool drr_fits(const drr_t *const me, uint8_t id, uint16_t len) {
+  /* A frame always fits in empty queues, whatever the limit */
+  return me->flow[id].num < me->depth &&
+         (me->bytes == 0 || me->bytes + len <= me->limit);
+}
+
+uint8_t drr_drop(drr_t *const me, uint8_t id) {
+  /* A full ring drops its own oldest frame, otherwise the longest queue pays
+   * for the shared budget */
+  if (me->flow[id].num < me->depth) {
+    uint32_t longest = 0;
+
+    for (uint16_t i = 0; i < me->active_num; i++) {
+      uint8_t active = me->active[(uint8_t)(me->active_head + i)];
+
+      if (me->flow[active].bytes > longest) {
+        longest = me->flow[active].bytes;
+        id = active;
+      }
+    }
+  }
+
+  pbuf_free(drr_pop(me, id));
+
+  return id;
+}
+
+void drr_enqueue(drr_t *const me, uint8_t id, struct pbuf *p) {
+  drr_flow_t *flow = &me->flow[id];
+  uint16_t tail = (flow->head + flow->num) % me->depth;
+
+  me->frame[id * me->depth + tail] = p;
+  flow->num++;
+  flow->bytes += p->tot_len;
+  me->bytes += p->tot_len;
+
+  /* A flow coming back from idle is served in the current round, so the
+   * sparse interactive flows overtake the backlogged ones */
+  if (!flow->active) {
+    flow->active = true;
+    flow->deficit = me->quantum;
+    me->active[(uint8_t)(me->active_head + me->active_num)] = id;
+    me->active_num++;
+  }
+}
+
+struct pbuf *drr_dequeue(drr_t *const me, uint8_t *id) {
+  while (me->active_num) {
+    uint8_t head = me->active[me->active_head];
+    drr_flow_t *flow = &me->flow[head];
+
+    if (flow->num == 0) {
+      /* Emptied by the drops, leaves the round */
+      flow->active = false;
+      flow->deficit = 0;
+      me->active_head++;
+      me->active_num--;
+      continue;
+    }
+
+    struct pbuf *p = me->frame[head * me->depth + flow->head];
+
+    if (flow->deficit < p->tot_len) {
+      /* Not enough credit left, gets a quantum and waits the next round */
+      flow->deficit += me->quantum;
+      me->active[(uint8_t)(me->active_head + me->active_num)] = head;
+      me->active_head++;
+      continue;
+    }
+
+    flow->deficit -= p->tot_len;
+    *id = head;
+
+    return drr_pop(me, head);
+  }
+
+  return NULL;
+}
+
+/* Private function definitions ----------------------------------------------*/
+static struct pbuf *drr_pop(drr_t *const me, uint8_t id) {
+  drr_flow_t *flow = &me->flow[id];
+  struct pbuf *p = me->frame[id * me->depth + flow->head];
+
+  flow->head = (flow->head + 1) % me->depth;
+  flow->num--;
+  flow->bytes -= p->tot_len;
+  me->bytes -= p->tot_len;
+
+  return p;
+}
+
+/***************************** END OF FILE ************************************/
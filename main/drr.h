@@ -0,0 +1,91 @@
+/**
+ ******************************************************************************
+ * @file           : drr.h
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Deficit round robin queue of frames
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef DRR_H_
+#define DRR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "lwip/pbuf.h"
+
+/* Exported Macros -----------------------------------------------------------*/
+#define DRR_FLOWS 256 /* One per last octet of the client address */
+
+/* Exported typedef ----------------------------------------------------------*/
+typedef struct {
+  uint16_t head; /* Oldest frame in the ring */
+  uint16_t num;
+  uint32_t bytes;
+  int32_t deficit;
+  bool active; /* In the round, maybe already empty after a drop */
+} drr_flow_t;
+
+typedef struct {
+  struct pbuf **frame; /* depth frames ring per flow */
+  drr_flow_t flow[DRR_FLOWS];
+  uint8_t active[DRR_FLOWS]; /* Round of the flows with frames */
+  uint8_t active_head;
+  uint16_t active_num;
+  uint16_t depth;
+  uint16_t quantum;
+  uint32_t bytes;
+  uint32_t limit;
+} drr_t;
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+esp_err_t drr_init(drr_t *const me, uint16_t depth, uint32_t limit,
+                   uint16_t quantum);
+bool drr_empty(const drr_t *const me);
+bool drr_fits(const drr_t *const me, uint8_t id, uint16_t len);
+uint8_t drr_drop(drr_t *const me, uint8_t id);
+void drr_enqueue(drr_t *const me, uint8_t id, struct pbuf *p);
+struct pbuf *drr_dequeue(drr_t *const me, uint8_t *id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRR_H_ */
+
+/***************************** END OF FILE ************************************/
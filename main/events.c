@@ -0,0 +1,395 @@
+/**
+ ******************************************************************************
+ * @file           : events.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Event queues and routing of triggers and responses
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "esp_timer.h"
+
+#include "routes.h"
+#include "typedefs.h"
+
+/* Private macros ------------------------------------------------------------*/
+/* Route tables generation from the routes.h lists */
+#define EVENT_ROUTE_CMDS(event, ...)                                           \
+  static const event_cmd_t event##_cmds[] = {__VA_ARGS__};
+#define EVENT_ROUTE_ENTRY(event, ...)                                          \
+  [event] = {event##_cmds, sizeof(event##_cmds) / sizeof(event_cmd_t)},
+#define EVENT_QUEUE_DEFINE(first, last, queue) static QueueHandle_t queue;
+#define EVENT_QUEUE_ENTRY(first, last, queue) [(first)...(last) - 1] = &queue,
+
+/* Payloads in flight at the same time */
+#ifndef EVENT_PAYLOAD_POOL_SIZE
+#define EVENT_PAYLOAD_POOL_SIZE 4
+#endif
+
+/* Log2 latency bins in us, the bin i counts [2^(i-1), 2^i) and the last one
+ * everything above ~4 s */
+#define EVENT_HIST_BINS 24
+
+/* Queues created through event_queue_create() */
+#define EVENT_QUEUES_MAX 8
+
+/* External variables --------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum {
+  EVENT_HOP_TRG = 0, /* Trigger queue to the triggers manager */
+  EVENT_HOP_RSP,     /* Response queue to the responses manager */
+  EVENT_HOP_CMD,     /* Command queue to the task that runs it */
+  EVENT_HOP_MAX
+} event_hop_t;
+
+/* What to do when the destination queue of an event is full */
+typedef enum {
+  EVENT_POLICY_DROP = 0, /* Drop the event and count it */
+  EVENT_POLICY_BLOCK,    /* Wait up to a deadline, then drop it */
+  EVENT_POLICY_COALESCE, /* Keep at most one copy pending in the queue */
+} event_policy_t;
+
+typedef struct {
+  uint32_t bin[EVENT_HIST_BINS];
+} event_hist_t;
+
+/* Delivery settings and stats of an event number on a hop */
+typedef struct {
+  event_hist_t hist;
+  uint8_t policy;
+  bool urgent;
+  uint16_t wait_ms;
+  atomic_bool pending;
+} event_entry_t;
+
+typedef struct {
+  QueueHandle_t handle;
+  const char *name;
+  UBaseType_t len;
+  UBaseType_t high_water;
+  atomic_uint_least32_t drops;
+  atomic_uint_least32_t coalesced;
+} event_queue_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Input and Output queues */
+static QueueHandle_t event_triggers_queue;
+static QueueHandle_t event_urgent_queue;
+static QueueHandle_t event_responses_queue;
+
+/* Urgent and bulk triggers lanes */
+static QueueSetHandle_t event_triggers_set;
+
+/* Commands queues */
+EVENT_CMD_QUEUES(EVENT_QUEUE_DEFINE)
+
+/* Queue of each command, the handles are filled when the queues are created */
+static QueueHandle_t *const event_cmd_queues[EVENT_CMD_MAX] = {
+    EVENT_CMD_QUEUES(EVENT_QUEUE_ENTRY)};
+
+/* Commands of each route */
+EVENT_TRG_ROUTES(EVENT_ROUTE_CMDS)
+EVENT_RSP_ROUTES(EVENT_ROUTE_CMDS)
+
+/* Triggers to commands routes */
+static const event_route_t event_trg_routes[EVENT_TRG_MAX] = {
+    EVENT_TRG_ROUTES(EVENT_ROUTE_ENTRY)};
+
+/* Responses to commands routes */
+static const event_route_t event_rsp_routes[EVENT_RSP_MAX] = {
+    EVENT_RSP_ROUTES(EVENT_ROUTE_ENTRY)};
+
+/* Preallocated payloads, free when their references count is zero */
+static event_payload_t event_payload_pool[EVENT_PAYLOAD_POOL_SIZE];
+
+/* Per hop and event number entries, each histogram has a single writer: the
+ * task that owns the queue */
+static event_entry_t event_entry_trg[EVENT_TRG_MAX];
+static event_entry_t event_entry_rsp[EVENT_RSP_MAX];
+static event_entry_t event_entry_cmd[EVENT_CMD_MAX];
+
+/* Queues stats */
+static event_queue_t event_queues[EVENT_QUEUES_MAX];
+static uint8_t event_queues_num;
+
+/* Private function prototypes -----------------------------------------------*/
+static event_entry_t *event_entry(event_hop_t hop, int num);
+static event_queue_t *event_queue_find(QueueHandle_t queue);
+static bool event_send(QueueHandle_t queue, event_hop_t hop,
+                       event_t *const event, bool is_isr);
+static uint32_t event_now(void);
+
+/* Exported functions definitions --------------------------------------------*/
+QueueHandle_t event_queue_create(const char *name, UBaseType_t len) {
+  if (event_queues_num == EVENT_QUEUES_MAX) {
+    return NULL;
+  }
+
+  QueueHandle_t handle = xQueueCreate(len, sizeof(event_t));
+
+  if (handle != NULL) {
+    event_queue_t *queue = &event_queues[event_queues_num++];
+    queue->handle = handle;
+    queue->name = name;
+    queue->len = len;
+  }
+
+  return handle;
+}
+
+void event_set_policy(event_hop_t hop, int num, event_policy_t policy,
+                      uint16_t wait_ms) {
+  event_entry_t *entry = event_entry(hop, num);
+
+  if (entry != NULL) {
+    entry->policy = policy;
+    entry->wait_ms = wait_ms;
+  }
+}
+
+void event_set_urgent(event_hop_t hop, int num) {
+  event_entry_t *entry = event_entry(hop, num);
+
+  if (entry != NULL) {
+    entry->urgent = true;
+  }
+}
+
+event_payload_t *event_payload_alloc(void) {
+  for (uint8_t i = 0; i < EVENT_PAYLOAD_POOL_SIZE; i++) {
+    uint_least8_t free = 0;
+
+    if (atomic_compare_exchange_strong(&event_payload_pool[i].refs, &free, 1)) {
+      return &event_payload_pool[i];
+    }
+  }
+
+  return NULL;
+}
+
+void event_release(event_t *const event) {
+  if (event->payload != NULL) {
+    atomic_fetch_sub(&event->payload->refs, 1);
+    event->payload = NULL;
+  }
+}
+
+/* Every queued copy of an event holds its own payload reference, the sender
+ * keeps its reference and releases it when done */
+bool event_send_response(event_t *const event, event_rsp_t rsp) {
+  event->num = rsp;
+  return event_send(event_responses_queue, EVENT_HOP_RSP, event, false);
+}
+
+bool event_send_trigger(event_t *const event, event_rsp_t trg, bool is_isr) {
+  event_entry_t *entry = event_entry(EVENT_HOP_TRG, trg);
+  bool urgent = entry != NULL && entry->urgent && event_urgent_queue != NULL;
+
+  event->num = trg;
+  return event_send(urgent ? event_urgent_queue : event_triggers_queue,
+                    EVENT_HOP_TRG, event, is_isr);
+}
+
+void event_route(event_t *const event, const event_route_t *routes) {
+  const event_route_t *route = &routes[event->num];
+
+  for (uint8_t i = 0; i < route->num; i++) {
+    event->num = route->cmds[i];
+    event_send(*event_cmd_queues[event->num], EVENT_HOP_CMD, event, false);
+  }
+}
+
+BaseType_t event_receive(QueueHandle_t queue, event_t *const event,
+                         TickType_t wait) {
+  BaseType_t status = xQueueReceive(queue, event, wait);
+
+  if (status != pdPASS) {
+    return status;
+  }
+
+  event_hop_t hop = EVENT_HOP_CMD;
+
+  if (queue == event_triggers_queue || queue == event_urgent_queue) {
+    hop = EVENT_HOP_TRG;
+  } else if (queue == event_responses_queue) {
+    hop = EVENT_HOP_RSP;
+  }
+
+  event_entry_t *entry = event_entry(hop, event->num);
+
+  if (entry == NULL) {
+    return status;
+  }
+
+  /* A coalesced event can be queued again once it left the queue */
+  atomic_store(&entry->pending, false);
+
+  /* Record how long the event waited in the queue */
+  uint32_t latency = event_now() - event->timestamp;
+  uint8_t bin = latency ? 32 - __builtin_clz(latency) : 0;
+  entry->hist.bin[bin < EVENT_HIST_BINS ? bin : EVENT_HIST_BINS - 1]++;
+
+  return status;
+}
+
+BaseType_t event_receive_trigger(event_t *const event, TickType_t wait) {
+  if (xQueueSelectFromSet(event_triggers_set, wait) == NULL) {
+    return pdFALSE;
+  }
+
+  /* The set only counts the queued triggers, the urgent ones are always
+   * taken first whatever lane it selected */
+  if (event_receive(event_urgent_queue, event, 0) == pdPASS) {
+    return pdPASS;
+  }
+
+  return event_receive(event_triggers_queue, event, 0);
+}
+
+const event_hist_t *event_get_hist(event_hop_t hop, int num) {
+  event_entry_t *entry = event_entry(hop, num);
+
+  return entry != NULL ? &entry->hist : NULL;
+}
+
+const event_queue_t *event_get_queue(uint8_t idx) {
+  return idx < event_queues_num ? &event_queues[idx] : NULL;
+}
+
+/* Private function definitions ----------------------------------------------*/
+static event_entry_t *event_entry(event_hop_t hop, int num) {
+  switch (hop) {
+  case EVENT_HOP_TRG:
+    return num >= 0 && num < EVENT_TRG_MAX ? &event_entry_trg[num] : NULL;
+  case EVENT_HOP_RSP:
+    return num >= 0 && num < EVENT_RSP_MAX ? &event_entry_rsp[num] : NULL;
+  case EVENT_HOP_CMD:
+    return num > EVENT_CMD_NO && num < EVENT_CMD_MAX ? &event_entry_cmd[num]
+                                                     : NULL;
+  default:
+    return NULL;
+  }
+}
+
+static event_queue_t *event_queue_find(QueueHandle_t queue) {
+  for (uint8_t i = 0; i < event_queues_num; i++) {
+    if (event_queues[i].handle == queue) {
+      return &event_queues[i];
+    }
+  }
+
+  return NULL;
+}
+
+static bool event_send(QueueHandle_t queue, event_hop_t hop,
+                       event_t *const event, bool is_isr) {
+  BaseType_t higher_priority_task_woken = pdFALSE;
+  BaseType_t status;
+  event_entry_t *entry = event_entry(hop, event->num);
+  event_queue_t *stats = event_queue_find(queue);
+  TickType_t wait = 0;
+
+  if (entry != NULL && entry->policy == EVENT_POLICY_COALESCE &&
+      atomic_exchange(&entry->pending, true)) {
+    /* The copy already waiting in the queue stands for this one */
+    if (stats != NULL) {
+      atomic_fetch_add(&stats->coalesced, 1);
+    }
+
+    return true;
+  }
+
+  /* Blocking is not possible from an ISR, the event is dropped there */
+  if (entry != NULL && entry->policy == EVENT_POLICY_BLOCK && !is_isr) {
+    wait = pdMS_TO_TICKS(entry->wait_ms);
+  }
+
+  if (event->payload != NULL) {
+    atomic_fetch_add(&event->payload->refs, 1);
+  }
+
+  event->timestamp = event_now();
+
+  /* Urgent commands go ahead of the ones already queued for their task */
+  bool front = hop == EVENT_HOP_CMD && entry != NULL && entry->urgent;
+
+  if (is_isr) {
+    status = front ? xQueueSendToFrontFromISR(queue, event,
+                                              &higher_priority_task_woken)
+                   : xQueueSendFromISR(queue, event,
+                                       &higher_priority_task_woken);
+  } else {
+    status = front ? xQueueSendToFront(queue, event, wait)
+                   : xQueueSend(queue, event, wait);
+  }
+
+  if (status == pdPASS) {
+    if (stats != NULL) {
+      UBaseType_t waiting = is_isr ? uxQueueMessagesWaitingFromISR(queue)
+                                   : uxQueueMessagesWaiting(queue);
+
+      if (waiting > stats->high_water) {
+        stats->high_water = waiting;
+      }
+    }
+  } else {
+    /* The dropped copy gives its reference back */
+    if (event->payload != NULL) {
+      atomic_fetch_sub(&event->payload->refs, 1);
+    }
+
+    if (entry != NULL && entry->policy == EVENT_POLICY_COALESCE) {
+      atomic_store(&entry->pending, false);
+    }
+
+    if (stats != NULL) {
+      atomic_fetch_add(&stats->drops, 1);
+    }
+  }
+
+  if (is_isr) {
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+  }
+
+  return status == pdPASS;
+}
+
+static uint32_t event_now(void) {
+  /* Microseconds, the wrap every ~71 min cancels out in the differences */
+  return (uint32_t)esp_timer_get_time();
+}
+
+/***************************** END OF FILE ************************************/
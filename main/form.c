@@ -0,0 +1,230 @@
+/**
+ ******************************************************************************
+ * @file           : form.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Streaming form body parser
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/* Private macros ------------------------------------------------------------*/
+#define FORM_CHUNK_SIZE 64
+#define FORM_RECV_RETRIES 3
+
+/* External variables --------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+/* Reads an application/x-www-form-urlencoded body a chunk at once, nothing is
+ * allocated and the body is never held whole */
+typedef struct {
+  httpd_req_t *req;
+  size_t remaining; /* Body bytes not received yet */
+  char buf[FORM_CHUNK_SIZE];
+  uint8_t len;
+  uint8_t pos;
+  esp_err_t err; /* First receive error, the rest of the body is skipped */
+} form_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+static int form_getc(form_t *const me);
+static int form_peek(form_t *const me);
+static int form_read(form_t *const me, char *dst, size_t size, char stop,
+                     esp_err_t *status);
+static int form_hex(int c);
+
+/* Exported functions definitions --------------------------------------------*/
+esp_err_t form_begin(form_t *const me, httpd_req_t *req, size_t max) {
+  me->req = req;
+  me->remaining = req->content_len;
+  me->len = 0;
+  me->pos = 0;
+  me->err = ESP_OK;
+
+  return req->content_len > max ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+esp_err_t form_next(form_t *const me, char *key, size_t key_size, char *value,
+                    size_t value_size) {
+  esp_err_t status = ESP_OK;
+  int end;
+
+  /* Empty pairs, as in "a=1&&b=2", are skipped */
+  do {
+    if (me->remaining == 0 && me->pos == me->len) {
+      return me->err != ESP_OK ? me->err : ESP_ERR_NOT_FOUND;
+    }
+
+    end = form_read(me, key, key_size, '=', &status);
+  } while (key[0] == '\0' && end == '&');
+
+  /* A key without '=' has an empty value */
+  value[0] = '\0';
+
+  if (end == '=') {
+    form_read(me, value, value_size, '&', &status);
+  }
+
+  if (me->err != ESP_OK) {
+    return me->err;
+  }
+
+  return status;
+}
+
+bool form_parse_uint(const char *value, uint32_t max, uint32_t *num) {
+  char *end;
+
+  if (value[0] < '0' || value[0] > '9') {
+    return false;
+  }
+
+  unsigned long parsed = strtoul(value, &end, 10);
+
+  if (*end != '\0' || parsed > max) {
+    return false;
+  }
+
+  *num = parsed;
+
+  return true;
+}
+
+/* Private function definitions ----------------------------------------------*/
+static int form_getc(form_t *const me) {
+  if (me->pos == me->len) {
+    int received = 0;
+
+    for (uint8_t i = 0; me->remaining > 0 && i < FORM_RECV_RETRIES; i++) {
+      received = httpd_req_recv(me->req, me->buf,
+                                me->remaining < sizeof(me->buf)
+                                    ? me->remaining
+                                    : sizeof(me->buf));
+
+      if (received != HTTPD_SOCK_ERR_TIMEOUT) {
+        break;
+      }
+    }
+
+    if (received <= 0) {
+      if (me->remaining > 0 && me->err == ESP_OK) {
+        me->err = ESP_FAIL;
+      }
+
+      /* Nothing else is read from a broken body */
+      me->remaining = 0;
+      return -1;
+    }
+
+    me->remaining -= received;
+    me->len = received;
+    me->pos = 0;
+  }
+
+  return (unsigned char)me->buf[me->pos++];
+}
+
+static int form_peek(form_t *const me) {
+  int c = form_getc(me);
+
+  /* Put back, the chunk keeps it until the next read */
+  if (c >= 0) {
+    me->pos--;
+  }
+
+  return c;
+}
+
+static int form_read(form_t *const me, char *dst, size_t size, char stop,
+                     esp_err_t *status) {
+  size_t len = 0;
+  int c;
+
+  /* Up to the stop character, '&' or the end of the body, decoded */
+  while ((c = form_getc(me)) >= 0 && c != stop && c != '&') {
+    if (c == '+') {
+      c = ' ';
+    } else if (c == '%') {
+      int high, low = -1;
+
+      /* The digits are only taken when valid, so a bad escape never takes
+       * the separator after it */
+      if ((high = form_hex(form_peek(me))) >= 0) {
+        form_getc(me);
+
+        if ((low = form_hex(form_peek(me))) >= 0) {
+          form_getc(me);
+        }
+      }
+
+      /* A bad escape fails the pair and decodes to nothing */
+      if (high < 0 || low < 0) {
+        if (*status == ESP_OK) {
+          *status = ESP_ERR_INVALID_ARG;
+        }
+
+        continue;
+      }
+
+      c = high << 4 | low;
+    }
+
+    if (len + 1 < size) {
+      dst[len++] = c;
+    } else if (*status == ESP_OK) {
+      *status = ESP_ERR_INVALID_SIZE;
+    }
+  }
+
+  dst[len] = '\0';
+
+  return c;
+}
+
+static int form_hex(int c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+
+  return -1;
+}
+
+/***************************** END OF FILE ************************************/
@@ -0,0 +1,210 @@
+/**
+ ******************************************************************************
+ * @file           : health.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Ring buffer of NAPT, IP and heap health samples
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "lwip/lwip_napt.h"
+#include "lwip/stats.h"
+#include "typedefs.h"
+
+/* Private macros ------------------------------------------------------------*/
+/* Binary download header */
+#define HEALTH_MAGIC "NFHS"
+#define HEALTH_VERSION 1
+
+/* External variables --------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+/* One sample, also the binary record, all fields little endian */
+typedef struct __attribute__((packed)) {
+  uint32_t time; /* Seconds since boot */
+  uint16_t napt_tcp;
+  uint16_t napt_udp;
+  uint16_t napt_icmp;
+  uint16_t reserved;
+  uint32_t napt_evictions;
+  uint32_t ip_forwarded;
+  uint32_t ip_dropped;
+  uint32_t dram_free;
+  uint32_t dram_largest;
+  uint32_t psram_free;
+  uint32_t psram_largest;
+} health_sample_t;
+
+typedef struct __attribute__((packed)) {
+  char magic[4];
+  uint16_t version;
+  uint16_t sample_size;
+  uint32_t num;    /* Samples following the header, oldest first */
+  uint32_t period; /* Seconds between samples */
+} health_header_t;
+
+typedef struct {
+  health_sample_t *sample;
+  uint16_t size;
+  uint32_t period;
+  uint32_t forwarded; /* lwIP counters when last recorded */
+  uint32_t dropped;
+  atomic_uint_least32_t count; /* Samples recorded since boot */
+} health_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+
+/* Exported functions definitions --------------------------------------------*/
+esp_err_t health_init(health_t *const me, uint16_t size, uint32_t period) {
+  me->size = size;
+  me->period = period;
+  me->forwarded = 0;
+  me->dropped = 0;
+  atomic_store(&me->count, 0);
+
+  if (size == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  /* The samples go to PSRAM when available */
+  me->sample = (health_sample_t *)heap_caps_calloc(
+      size, sizeof(health_sample_t), MALLOC_CAP_SPIRAM);
+
+  if (me->sample == NULL) {
+    me->sample = (health_sample_t *)heap_caps_calloc(
+        size, sizeof(health_sample_t), MALLOC_CAP_DEFAULT);
+  }
+
+  if (me->sample == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  return ESP_OK;
+}
+
+void health_sample(event_health_t *health) {
+  ip_napt_get_stats(&health->napt_stats);
+  heap_caps_get_info(&health->heap_dram, MALLOC_CAP_INTERNAL);
+  heap_caps_get_info(&health->heap_psram, MALLOC_CAP_SPIRAM);
+
+#if IP_STATS
+  health->ip_forwarded = lwip_stats.ip.fw;
+  health->ip_dropped = lwip_stats.ip.drop;
+#endif
+}
+
+void health_record(health_t *const me, const event_health_t *health,
+                   uint32_t time) {
+  if (me->sample == NULL) {
+    return;
+  }
+
+  uint32_t count = atomic_load(&me->count);
+  health_sample_t *sample = &me->sample[count % me->size];
+  uint32_t forwarded = 0, dropped = 0;
+
+  /* The lwIP counters may be 16 bits wide, the totals grow by their
+   * difference since the previous sample */
+  if (count) {
+    const health_sample_t *prev = &me->sample[(count - 1) % me->size];
+    forwarded = prev->ip_forwarded +
+                (STAT_COUNTER)(health->ip_forwarded - me->forwarded);
+    dropped =
+        prev->ip_dropped + (STAT_COUNTER)(health->ip_dropped - me->dropped);
+  }
+
+  sample->time = time;
+  sample->napt_tcp = health->napt_stats.nr_active_tcp;
+  sample->napt_udp = health->napt_stats.nr_active_udp;
+  sample->napt_icmp = health->napt_stats.nr_active_icmp;
+  sample->reserved = 0;
+  sample->napt_evictions = health->napt_stats.nr_forced_evictions;
+  sample->ip_forwarded = forwarded;
+  sample->ip_dropped = dropped;
+  sample->dram_free = health->heap_dram.total_free_bytes;
+  sample->dram_largest = health->heap_dram.largest_free_block;
+  sample->psram_free = health->heap_psram.total_free_bytes;
+  sample->psram_largest = health->heap_psram.largest_free_block;
+
+  me->forwarded = health->ip_forwarded;
+  me->dropped = health->ip_dropped;
+
+  /* Published after the slot is complete */
+  atomic_store(&me->count, count + 1);
+}
+
+uint32_t health_get_first(health_t *const me, uint32_t *num) {
+  uint32_t count = atomic_load(&me->count);
+
+  /* The oldest slot is left out, the next record overwrites it */
+  *num = count < me->size ? count : me->size - 1;
+
+  return count - *num;
+}
+
+bool health_get(health_t *const me, uint32_t seq, health_sample_t *sample) {
+  uint32_t count = atomic_load(&me->count);
+
+  /* Samples are addressed by their record number, valid while in the ring */
+  if (seq >= count || count - seq >= me->size) {
+    return false;
+  }
+
+  memcpy(sample, &me->sample[seq % me->size], sizeof(health_sample_t));
+
+  return true;
+}
+
+bool health_get_last(health_t *const me, health_sample_t *sample) {
+  uint32_t count = atomic_load(&me->count);
+
+  return count && health_get(me, count - 1, sample);
+}
+
+void health_get_header(health_t *const me, health_header_t *header,
+                       uint32_t num) {
+  memcpy(header->magic, HEALTH_MAGIC, sizeof(header->magic));
+  header->version = HEALTH_VERSION;
+  header->sample_size = sizeof(health_sample_t);
+  header->num = num;
+  header->period = me->period;
+}
+
+/* Private function definitions ----------------------------------------------*/
+
+/***************************** END OF FILE ************************************/
@@ -33,13 +33,17 @@
  */
 
 /* Includes ------------------------------------------------------------------*/
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "esp_err.h"
+#include "esp_heap_caps.h"
 #include "esp_system.h"
+#include "esp_task.h"
+#include "esp_timer.h"
 #include "esp_wifi_types_generic.h"
 #include "freertos/idf_additions.h"
 #include "freertos/projdefs.h"
@@ -70,11 +74,21 @@
 #include "led.h"
 #include "tpl5010.h"
 
+#include "assets.c"
+#include "blocklist.c"
 #include "clients.c"
+#include "dns_cache.c"
+#include "dns.c"
+#include "drr.c"
+#include "events.c"
+#include "form.c"
+#include "health.c"
+#include "metrics.c"
 #include "misc.c"
 #include "nvs.c"
 #include "server.c"
 #include "settings.c"
+#include "traffic.c"
 #include "typedefs.h"
 
 /* Macros --------------------------------------------------------------------*/
@@ -87,24 +101,40 @@
 #define BUZZER_PIN CONFIG_PERIPHERALS_BUZZER_PIN
 #define LED_PIN CONFIG_PERIPHERALS_LEDS_PIN
 
-/* SPIFFS macros */
-#define SPIFFS_BASE_PATH "/spiffs"
+/* Blocklist macros */
+#define BLOCKLIST_PARTITION_LABEL "blocklist"
 
-/**/
-#define APP_QUEUE_LEN_DEFAULT 5
+/* Web assets macros */
+#define ASSETS_PARTITION_LABEL "www"
 
-/**/
-#define APP_ROUTE_CMD_MAX 3
+/* Server macros, the largest request bodies accepted */
+#define SERVER_LOGIN_BODY_MAX 64
+#define SERVER_SETTINGS_BODY_MAX 256
+
+/* Network macros */
+#define AP_IP_ADDR "192.168.4.1"
+
+/* Tasks reported by /metrics */
+#define METRICS_TASKS_MAX 32
+
+/* Per-client traffic snapshots period */
+#define TRAFFIC_SNAPSHOT_PERIOD_MS 5000
+
+/* Fair queue round quantum, a full Ethernet frame */
+#define TRAFFIC_FAIR_QUEUE_QUANTUM 1514
 
 /**/
 #define APP_TASK_HEALTH_MONITOR_PRIORITY tskIDLE_PRIORITY + 1
+#define APP_TASK_TRAFFIC_PRIORITY tskIDLE_PRIORITY + 1
 #define APP_TASK_ACTIONS_PRIORITY tskIDLE_PRIORITY + 2
 #define APP_TASK_ALERTS_PRIORITY tskIDLE_PRIORITY + 3
 #define APP_TASK_NETWORK_PRIORITY tskIDLE_PRIORITY + 4
+#define APP_TASK_DNS_PRIORITY tskIDLE_PRIORITY + 4
 #define APP_TASK_CLIENTS_PRIORITY tskIDLE_PRIORITY + 5
-#define APP_TASK_TICK_PRIORITY tskIDLE_PRIORITY + 6
 #define APP_TASK_RESPONSES_MANAGER_PRIORITY tskIDLE_PRIORITY + 8
 #define APP_TASK_TRIGGERS_MANAGER_PRIORITY tskIDLE_PRIORITY + 9
+#define APP_TASK_WDT_PRIORITY tskIDLE_PRIORITY + 10
+#define APP_TASK_FAIR_QUEUE_PRIORITY ESP_TASK_TCPIP_PRIO - 1
 
 /* Typedef -------------------------------------------------------------------*/
 
@@ -116,6 +146,14 @@ static uint8_t serial_number[AT24CS0X_SN_SIZE];
 static uint8_t mac_addr[6];
 static settings_t settings;
 static clients_t clients;
+static blocklist_t blocklist;
+static assets_t assets;
+static dns_cache_t dns_cache;
+static dns_t dns;
+static traffic_t traffic;
+static health_t health;
+static atomic_bool health_online;
+static atomic_uint_least32_t health_rtt_us; /* Last successful probe */
 static uint32_t otp = 0;
 
 /* Components */
@@ -124,6 +162,7 @@ static led_t led;
 static buzzer_t buzzer;
 static at24cs0x_t eeprom;
 static tpl5010_t wdt;
+static TaskHandle_t wdt_task_handle;
 static i2c_master_bus_handle_t i2c_bus_handle;
 static fsm_t fsm;
 
@@ -160,23 +199,6 @@ sound_t sound_startup[] = {
     {1500, 60, 80}, {1800, 100, 90},
 };
 
-/* Input and Output queues */
-static QueueHandle_t event_triggers_queue;
-static QueueHandle_t event_responses_queue;
-static QueueHandle_t clients_commands_queue;
-static QueueHandle_t actions_commands_queue;
-static QueueHandle_t network_commands_queue;
-static QueueHandle_t alerts_commands_queue;
-
-/* Commands queue array */
-static QueueHandle_t event_cmd_queues[EVENT_CMD_MAX] = {0};
-
-/* Triggers to commands map  */
-static event_cmd_t event_trg_map[EVENT_TRG_MAX][APP_ROUTE_CMD_MAX];
-
-/* Responses to commands map  */
-static event_cmd_t event_rsp_map[EVENT_RSP_MAX][APP_ROUTE_CMD_MAX];
-
 /* Alerts FSM events */
 static int alerts_process = ALERTS_PROCESS_CLEAR;
 static int alerts_idle = ALERTS_IDLE_CLEAR;
@@ -198,6 +220,8 @@ static void ip_event_handler(void *arg, esp_event_base_t event_base,
                              int32_t event_id, void *event_data);
 static void prov_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data);
+static void traffic_event_handler(void *arg, esp_event_base_t event_base,
+                                  int32_t event_id, void *event_data);
 
 /* Provisioning utils */
 static char *get_device_service_name(const char *ssid_prefix);
@@ -208,145 +232,84 @@ static esp_err_t custom_prov_data_handler(uint32_t session_id,
 
 /* Utils */
 static void print_dev_info(void);
+static bool otp_check(httpd_req_t *req);
+static bool metrics_token_check(httpd_req_t *req);
+static bool settings_key_check(const char *key);
 
 /* RTOS tasks */
-static void tick_task(void *arg);
 static void health_monitor_task(void *arg);
-static int tls_health_check(void);
+static void traffic_task(void *arg);
+static void fair_queue_task(void *arg);
+static void dns_task(void *arg);
+static int tls_health_check(uint32_t *rtt_us);
 
-static char *read_http_response(httpd_req_t *req);
 static esp_err_t settings_save_handler(httpd_req_t *req);
 static esp_err_t settings_load_handler(httpd_req_t *req);
 static esp_err_t login_handler(httpd_req_t *req);
-
-static esp_err_t spiffs_init(const char *base_path);
+static esp_err_t dns_stats_handler(httpd_req_t *req);
+static esp_err_t event_stats_handler(httpd_req_t *req);
+static esp_err_t traffic_handler(httpd_req_t *req);
+static esp_err_t health_handler(httpd_req_t *req);
+static esp_err_t health_bin_handler(httpd_req_t *req);
+static esp_err_t metrics_handler(httpd_req_t *req);
 
 static void delay_ms(uint32_t ms);
 
 /**/
 static esp_err_t app_create_queues(void);
 static esp_err_t app_create_tasks(void);
+static void wdt_task(void *arg);
 static void triggers_manager_task(void *arg);
 static void responses_manager_task(void *arg);
 static void alerts_task(void *arg);
 static void network_task(void *arg);
 static void actions_task(void *arg);
 static void clients_task(void *arg);
+static TickType_t clients_wait_ticks(int64_t deadline, int64_t now);
 
 static void button_cb(void *arg);
 static void wdt_cb(void *arg);
 static int eeprom_read_cb(uint8_t data_addr, uint8_t *data, uint32_t data_len);
 static int eeprom_write_cb(uint8_t data_addr, uint8_t *data, uint32_t data_len);
 
-static void event_assign_cmds_queue(int first, int last,
-                                    QueueHandle_t cmd_queue);
-static void event_register_route(event_cmd_t (*map)[APP_ROUTE_CMD_MAX],
-                                 int event, int cmd1, int cmd2, int cmd3);
-
-static void event_send_response(event_t *const me, event_rsp_t rsp);
-static void event_send_trigger(event_t *const event, event_rsp_t trg,
-                               bool is_isr);
-static void event_route(event_t *const event,
-                        event_cmd_t (*map)[APP_ROUTE_CMD_MAX]);
-
 static void on_idle_update(void);
 static void on_process_enter(void);
 static void on_signal_enter(void);
 
 /* Main ----------------------------------------------------------------------*/
 void app_main(void) {
+  /* Ring of health samples, filled by the health monitor task */
+  if (health_init(&health, CONFIG_HEALTH_SAMPLES, CONFIG_HEALTH_PERIOD) !=
+      ESP_OK) {
+    ESP_LOGW(TAG, "Failed to initialize the health samples");
+  }
+
   /* Create queues and tasks to manage app events */
   ESP_ERROR_CHECK(app_create_queues());
   ESP_ERROR_CHECK(app_create_tasks());
 
-  /* Assign commands to a process queue according their function */
-  event_assign_cmds_queue(EVENT_CMD_ALERTS_IDLE_ONLINE, EVENT_CMD_ALERTS_MAX,
-                          alerts_commands_queue);
-  event_assign_cmds_queue(EVENT_CMD_NETWORK_OTA, EVENT_CMD_NETWORK_MAX,
-                          network_commands_queue);
-  event_assign_cmds_queue(EVENT_CMD_CLIENTS_ADD, EVENT_CMD_CLIENTS_MAX,
-                          clients_commands_queue);
-  event_assign_cmds_queue(EVENT_CMD_ACTIONS_RESET, EVENT_CMD_ACTIONS_MAX,
-                          actions_commands_queue);
-
-  /* Register triggers to commands routes */
-  event_register_route(event_trg_map, EVENT_TRG_BUTTON_SHORT,
-                       EVENT_CMD_ACTIONS_RESET, EVENT_CMD_NO, EVENT_CMD_NO);
-  event_register_route(event_trg_map, EVENT_TRG_BUTTON_MEDIUM,
-                       EVENT_CMD_NETWORK_OTA, EVENT_CMD_NO, EVENT_CMD_NO);
-  event_register_route(event_trg_map, EVENT_TRG_BUTTON_LONG,
-                       EVENT_CMD_ACTIONS_RESTORE, EVENT_CMD_NO, EVENT_CMD_NO);
-
-  event_register_route(event_trg_map, EVENT_TRG_WIFI_AP_STACONNECTED,
-                       EVENT_CMD_CLIENTS_ADD, EVENT_CMD_NO, EVENT_CMD_NO);
-  event_register_route(event_trg_map, EVENT_TRG_WIFI_AP_STADISCONNECTED,
-                       EVENT_CMD_CLIENTS_REMOVE, EVENT_CMD_NO, EVENT_CMD_NO);
-  event_register_route(event_trg_map, EVENT_TRG_WIFI_STA_DISCONNECTED,
-                       EVENT_CMD_NETWORK_RECONNECT,
-                       EVENT_CMD_ALERTS_IDLE_DISCONNECTED, EVENT_CMD_NO);
-
-  event_register_route(event_trg_map, EVENT_TRG_PROV_START,
-                       EVENT_CMD_ALERTS_PROCESS_PROV, EVENT_CMD_NO,
-                       EVENT_CMD_NO);
-  event_register_route(event_trg_map, EVENT_TRG_PROV_END,
-                       EVENT_CMD_ACTIONS_RESET, EVENT_CMD_NO, EVENT_CMD_NO);
-  event_register_route(event_trg_map, EVENT_TRG_PROV_FAIL,
-                       EVENT_CMD_ACTIONS_RESTORE, EVENT_CMD_NO, EVENT_CMD_NO);
-
-  event_register_route(event_trg_map, EVENT_TRG_HEALTH_INTERNET,
-                       EVENT_CMD_ALERTS_IDLE_ONLINE, EVENT_CMD_NO,
-                       EVENT_CMD_NO);
-  event_register_route(event_trg_map, EVENT_TRG_HEALTH_NO_INTERNET,
-                       EVENT_CMD_ALERTS_IDLE_OFFLINE, EVENT_CMD_NO,
-                       EVENT_CMD_NO);
-
-  event_register_route(event_trg_map, EVENT_TRG_WDT, EVENT_CMD_ACTIONS_WDT,
-                       EVENT_CMD_NO, EVENT_CMD_NO);
-  event_register_route(event_trg_map, EVENT_TRG_TICK, EVENT_CMD_CLIENTS_TICK,
-                       EVENT_CMD_NO, EVENT_CMD_NO);
-  event_register_route(event_trg_map, EVENT_TRG_IP_GOT,
-                       EVENT_CMD_ALERTS_IDLE_ONLINE, EVENT_CMD_NO,
-                       EVENT_CMD_NO);
-
-  /* Register responses to commands routes */
-  event_register_route(event_rsp_map, EVENT_RSP_ACTIONS_RESTORE_SUCCESS,
-                       EVENT_CMD_ACTIONS_RESET, EVENT_CMD_NO, EVENT_CMD_NO);
-  event_register_route(event_rsp_map, EVENT_RSP_ACTIONS_RESTORE_FAIL,
-                       EVENT_CMD_ALERTS_SIGNAL_FAIL, EVENT_CMD_NO,
-                       EVENT_CMD_NO);
-
-  event_register_route(event_rsp_map, EVENT_RSP_NETWORK_OTA_START,
-                       EVENT_CMD_ALERTS_PROCESS_OTA, EVENT_CMD_NO,
-                       EVENT_CMD_NO);
-  event_register_route(event_rsp_map, EVENT_RSP_NETWORK_OTA_SUCCESS,
-                       EVENT_CMD_ALERTS_PROCESS_END,
-                       EVENT_CMD_ALERTS_SIGNAL_SUCCESS,
-                       EVENT_CMD_ACTIONS_RESET);
-  event_register_route(event_rsp_map, EVENT_RSP_NETWORK_OTA_FAIL,
-                       EVENT_CMD_ALERTS_PROCESS_END,
-                       EVENT_CMD_ALERTS_SIGNAL_FAIL, EVENT_CMD_NO);
-  event_register_route(event_rsp_map, EVENT_RSP_NETWORK_OTA_TIMEOUT,
-                       EVENT_CMD_ALERTS_PROCESS_END,
-                       EVENT_CMD_ALERTS_SIGNAL_WARNING, EVENT_CMD_NO);
-  event_register_route(event_rsp_map, EVENT_RSP_NETWORK_RECONNECT_TIMEOUT,
-                       EVENT_CMD_ALERTS_SIGNAL_WARNING, EVENT_CMD_ACTIONS_RESET,
-                       EVENT_CMD_NO);
-
-  event_register_route(event_rsp_map, EVENT_RSP_CLIENTS_ADD_SUCCESS,
-                       EVENT_CMD_ALERTS_SIGNAL_SUCCESS, EVENT_CMD_NO,
-                       EVENT_CMD_NO);
-  event_register_route(event_rsp_map, EVENT_RSP_CLIENTS_ADD_FAIL,
-                       EVENT_CMD_NETWORK_DEAUTH, EVENT_CMD_NO, EVENT_CMD_NO);
-  event_register_route(event_rsp_map, EVENT_RSP_CLIENTS_ADD_FULL,
-                       EVENT_CMD_ALERTS_IDLE_FULL, EVENT_CMD_NO, EVENT_CMD_NO);
-  event_register_route(event_rsp_map, EVENT_RSP_CLIENTS_REMOVE_EMPTY,
-                       EVENT_CMD_ALERTS_IDLE_NO_FULL, EVENT_CMD_NO,
-                       EVENT_CMD_NO);
-  event_register_route(event_rsp_map, EVENT_RSP_CLIENTS_REMOVE_AVAILABLE,
-                       EVENT_CMD_ALERTS_IDLE_NO_FULL, EVENT_CMD_NO,
-                       EVENT_CMD_NO);
-  event_register_route(event_rsp_map, EVENT_RSP_CLIENTS_TICK_TIMEOUT,
-                       EVENT_CMD_NETWORK_DEAUTH, EVENT_CMD_NO, EVENT_CMD_NO);
+  /* Backpressure policies, the events not listed are dropped when their
+   * queue is full. Joins, leaves and kicks must not be lost */
+  event_set_policy(EVENT_HOP_TRG, EVENT_TRG_WIFI_AP_STACONNECTED,
+                   EVENT_POLICY_BLOCK, 100);
+  event_set_policy(EVENT_HOP_TRG, EVENT_TRG_WIFI_AP_STADISCONNECTED,
+                   EVENT_POLICY_BLOCK, 100);
+  event_set_policy(EVENT_HOP_CMD, EVENT_CMD_CLIENTS_ADD, EVENT_POLICY_BLOCK,
+                   100);
+  event_set_policy(EVENT_HOP_CMD, EVENT_CMD_CLIENTS_REMOVE, EVENT_POLICY_BLOCK,
+                   100);
+  event_set_policy(EVENT_HOP_RSP, EVENT_RSP_CLIENTS_TICK_TIMEOUT,
+                   EVENT_POLICY_BLOCK, 100);
+  event_set_policy(EVENT_HOP_CMD, EVENT_CMD_NETWORK_DEAUTH, EVENT_POLICY_BLOCK,
+                   100);
+
+  /* The button presses skip the queued bulk events */
+  event_set_urgent(EVENT_HOP_TRG, EVENT_TRG_BUTTON_SHORT);
+  event_set_urgent(EVENT_HOP_TRG, EVENT_TRG_BUTTON_MEDIUM);
+  event_set_urgent(EVENT_HOP_TRG, EVENT_TRG_BUTTON_LONG);
+  event_set_urgent(EVENT_HOP_CMD, EVENT_CMD_ACTIONS_RESET);
+  event_set_urgent(EVENT_HOP_CMD, EVENT_CMD_ACTIONS_RESTORE);
+  event_set_urgent(EVENT_HOP_CMD, EVENT_CMD_NETWORK_OTA);
 
   /* Initialize a LED instance */
   ESP_ERROR_CHECK(led_strip_init(&led, LED_PIN, 2));
@@ -413,15 +376,49 @@ void app_main(void) {
   if (provisioned) {
     ESP_LOGI(TAG, "Already provisioned. Connecting to AP...");
 
-    /* Initialize and configure file system and HTTP server */
-    ESP_ERROR_CHECK(spiffs_init(SPIFFS_BASE_PATH));
-    server_init(SPIFFS_BASE_PATH);
+    /* Map the web assets and initialize the HTTP server */
+    assets_init(&assets);
+
+    if (assets_load(&assets, ASSETS_PARTITION_LABEL) != ESP_OK) {
+      ESP_LOGW(TAG, "Failed to load the web assets");
+    }
+
+    server_init(&assets);
     server_uri_handler_add("/login", HTTP_POST, login_handler);
-    server_uri_handler_add("/set_settings", HTTP_POST, settings_save_handler);
+    server_uri_handler_add_async("/set_settings", HTTP_POST,
+                                 settings_save_handler);
     server_uri_handler_add("/get_settings", HTTP_POST, settings_load_handler);
+    server_uri_handler_add("/get_dns_stats", HTTP_POST, dns_stats_handler);
+    server_uri_handler_add("/get_event_stats", HTTP_POST, event_stats_handler);
+    server_uri_handler_add_async("/get_traffic", HTTP_POST, traffic_handler);
+    server_uri_handler_add_async("/get_health", HTTP_POST, health_handler);
+    server_uri_handler_add_async("/get_health_bin", HTTP_POST,
+                                 health_bin_handler);
+    server_uri_handler_add("/metrics", HTTP_GET, metrics_handler);
+
+    /* Map the blocklist and start the DNS forwarder for the AP clients */
+    blocklist_init(&blocklist);
+
+    if (blocklist_load(&blocklist, BLOCKLIST_PARTITION_LABEL) == ESP_OK) {
+      ESP_LOGI(TAG, "Blocklist loaded with %lu domains", blocklist.num);
+    }
+
+    dns_cache_t *cache = &dns_cache;
+
+    if (dns_cache_init(cache, CONFIG_DNS_CACHE_SIZE * 1024) != ESP_OK) {
+      ESP_LOGW(TAG, "Failed to initialize DNS cache");
+      cache = NULL;
+    }
+
+    if (dns_init(&dns, AP_IP_ADDR, CONFIG_DNS_UPSTREAM_SERVERS, &blocklist,
+                 cache) == ESP_OK) {
+      xTaskCreatePinnedToCore(dns_task, "DNS Task",
+                              configMINIMAL_STACK_SIZE * 4, &dns,
+                              APP_TASK_DNS_PRIORITY, NULL, 0);
+    }
 
     /* Initialize NAT */
-    ip_napt_enable(ipaddr_addr("192.168.4.1"), 1);
+    ip_napt_enable(ipaddr_addr(AP_IP_ADDR), 1);
     ESP_LOGI(TAG, "NAT is enabled");
 
     /* Connect to router */
@@ -473,9 +470,42 @@ static esp_err_t wifi_init(void) {
   }
 
   /* Create netif instances */
-  esp_netif_create_default_wifi_sta();
+  esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
   esp_netif_t *ap_netif = esp_netif_create_default_wifi_ap();
 
+  /* Count the traffic of each client on the AP interface */
+  if (traffic_init(&traffic, ap_netif, sta_netif, AP_IP_ADDR) != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to initialize traffic accounting");
+  } else {
+    /* Registered after the default handlers, which add the interfaces to
+     * lwIP on start, so the hooks are installed once they exist */
+    if (esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_AP_START,
+                                            &traffic_event_handler, NULL,
+                                            NULL) != ESP_OK ||
+        esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_STA_START,
+                                            &traffic_event_handler, NULL,
+                                            NULL) != ESP_OK) {
+      ESP_LOGW(TAG, "Failed to register the traffic hooks handler");
+    }
+
+    traffic_set_limit(&traffic, settings_get_rate(&settings),
+                      settings_get_burst(&settings));
+
+#ifdef CONFIG_TRAFFIC_FAIR_QUEUE
+    if (traffic_fair_queue_init(&traffic, CONFIG_TRAFFIC_FAIR_QUEUE_DEPTH,
+                                CONFIG_TRAFFIC_FAIR_QUEUE_SIZE * 1024,
+                                TRAFFIC_FAIR_QUEUE_QUANTUM) != ESP_OK ||
+        xTaskCreatePinnedToCore(fair_queue_task, "Fair Queue Task",
+                                configMINIMAL_STACK_SIZE * 3, NULL,
+                                APP_TASK_FAIR_QUEUE_PRIORITY, NULL,
+                                1) != pdPASS) {
+      /* The frames go straight to the stack without the scheduler */
+      traffic.inbox = NULL;
+      ESP_LOGW(TAG, "Failed to initialize the fair queue");
+    }
+#endif
+  }
+
   /* Set DHCP server */
   ret = esp_netif_dhcps_stop(ap_netif);
   if (ret != ESP_OK) {
@@ -491,8 +521,9 @@ static esp_err_t wifi_init(void) {
     return ret;
   }
 
+  /* Offer the local DNS forwarder to the clients */
   esp_netif_dns_info_t dns_info = {0};
-  dns_info.ip.u_addr.ip4.addr = ipaddr_addr("8.8.8.8");
+  dns_info.ip.u_addr.ip4.addr = ipaddr_addr(AP_IP_ADDR);
   dns_info.ip.type = IPADDR_TYPE_V4;
   ret = esp_netif_set_dns_info(ap_netif, ESP_NETIF_DNS_MAIN, &dns_info);
   if (ret != ESP_OK) {
@@ -520,6 +551,7 @@ static esp_err_t wifi_init(void) {
   /* Declare event handler instances for Wi-Fi and IP */
   esp_event_handler_instance_t instance_any_wifi;
   esp_event_handler_instance_t instance_got_ip;
+  esp_event_handler_instance_t instance_ip_assigned;
   esp_event_handler_instance_t instance_any_prov;
 
   /* Register Wi-Fi, IP and SmartConfig event handlers */
@@ -538,6 +570,14 @@ static esp_err_t wifi_init(void) {
     return ret;
   }
 
+  ret = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_AP_STAIPASSIGNED,
+                                            &ip_event_handler, NULL,
+                                            &instance_ip_assigned);
+
+  if (ret != ESP_OK) {
+    return ret;
+  }
+
   ret = esp_event_handler_instance_register(WIFI_PROV_EVENT, ESP_EVENT_ANY_ID,
                                             &prov_event_handler, NULL,
                                             &instance_any_prov);
@@ -592,7 +632,7 @@ static esp_err_t wifi_init(void) {
 /* Event handlers */
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data) {
-  event_t event;
+  event_t event = {0};
 
   switch (event_id) {
   case WIFI_EVENT_STA_DISCONNECTED: {
@@ -636,7 +676,7 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
 
 static void ip_event_handler(void *arg, esp_event_base_t event_base,
                              int32_t event_id, void *event_data) {
-  event_t event;
+  event_t event = {0};
 
   switch (event_id) {
   case IP_EVENT_STA_GOT_IP: {
@@ -645,6 +685,14 @@ static void ip_event_handler(void *arg, esp_event_base_t event_base,
     break;
   }
 
+  case IP_EVENT_AP_STAIPASSIGNED: {
+    ip_event_ap_staipassigned_t *assigned = event_data;
+    ESP_LOGI(TAG, "IP_EVENT_AP_STAIPASSIGNED " IPSTR " " MACSTR,
+             IP2STR(&assigned->ip), MAC2STR(assigned->mac));
+    traffic_lease(&traffic, &assigned->ip, assigned->mac);
+    break;
+  }
+
   default:
     ESP_LOGI(TAG, "Other IP event");
     break;
@@ -653,7 +701,7 @@ static void ip_event_handler(void *arg, esp_event_base_t event_base,
 
 static void prov_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data) {
-  event_t event;
+  event_t event = {0};
 
   switch (event_id) {
   case WIFI_PROV_START: {
@@ -681,6 +729,20 @@ static void prov_event_handler(void *arg, esp_event_base_t event_base,
   }
 }
 
+static void traffic_event_handler(void *arg, esp_event_base_t event_base,
+                                  int32_t event_id, void *event_data) {
+  /* Installed again on each start, the interfaces are added anew */
+  if (event_id == WIFI_EVENT_AP_START) {
+    if (traffic_attach_ap(&traffic) != ESP_OK) {
+      ESP_LOGW(TAG, "Per-client accounting disabled on the AP");
+    }
+  } else if (event_id == WIFI_EVENT_STA_START) {
+    if (traffic_attach_sta(&traffic) != ESP_OK) {
+      ESP_LOGW(TAG, "Uplink congestion not reported to the fair queue");
+    }
+  }
+}
+
 /* Provisioning utils */
 static char *get_device_service_name(const char *ssid_prefix) {
   char *name = NULL;
@@ -714,32 +776,65 @@ static esp_err_t custom_prov_data_handler(uint32_t session_id,
 }
 
 /* RTOS tasks */
-static void tick_task(void *arg) {
+static void health_monitor_task(void *arg) {
   TickType_t last_wake = xTaskGetTickCount();
-  event_t event;
+  event_t event = {0};
+  event_health_t sample;
 
   for (;;) {
-    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(1000));
-    event_send_trigger(&event, EVENT_TRG_TICK, false);
-  }
-}
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_HEALTH_PERIOD * 1000));
 
-static void health_monitor_task(void *arg) {
-  TickType_t last_wake = xTaskGetTickCount();
-  event_t event;
+    /* Keep the NAPT, IP and heap state in the ring, and attach it to the
+     * event when a payload is free */
+    health_sample(&sample);
+    health_record(&health, &sample, esp_timer_get_time() / 1000000);
+    event.payload = event_payload_alloc();
 
-  for (;;) {
-    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(10000));
+    if (event.payload != NULL) {
+      event.payload->data.health = sample;
+    }
 
-    if (!tls_health_check()) {
+    uint32_t rtt_us;
+    bool online = !tls_health_check(&rtt_us);
+    atomic_store(&health_online, online);
+
+    if (online) {
+      atomic_store(&health_rtt_us, rtt_us);
       event_send_trigger(&event, EVENT_TRG_HEALTH_INTERNET, false);
     } else {
       event_send_trigger(&event, EVENT_TRG_HEALTH_NO_INTERNET, false);
     }
+
+    event_release(&event);
+  }
+}
+
+static void traffic_task(void *arg) {
+  TickType_t last_wake = xTaskGetTickCount();
+
+  for (;;) {
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(TRAFFIC_SNAPSHOT_PERIOD_MS));
+    traffic_snapshot(&traffic);
+  }
+}
+
+static void fair_queue_task(void *arg) {
+  for (;;) {
+    traffic_schedule(&traffic);
   }
 }
 
-static int tls_health_check(void) {
+static void dns_task(void *arg) {
+  dns_t *dns = (dns_t *)arg;
+
+  ESP_LOGI(TAG, "DNS Task created! Waiting for incoming queries");
+
+  for (;;) {
+    dns_poll(dns, 1000);
+  }
+}
+
+static int tls_health_check(uint32_t *rtt_us) {
   const char *host = "google.com";
   const char *port = "443";
   struct addrinfo hints = {
@@ -761,7 +856,11 @@ static int tls_health_check(void) {
   struct timeval timeout = {.tv_sec = 5, .tv_usec = 0};
   setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
+  /* The TCP handshake time is the probe round trip */
+  int64_t start = esp_timer_get_time();
+
   if (connect(sock, res->ai_addr, res->ai_addrlen) == 0) {
+    *rtt_us = esp_timer_get_time() - start;
     ret = 0; /* Return OK */
   }
 
@@ -794,174 +893,515 @@ static void print_dev_info(void) {
   free(ap_prov_name);
 }
 
-static char *read_http_response(httpd_req_t *req) {
-  int remaining = req->content_len;
-  char *buf = ((struct file_server_data *)req->user_ctx)->scratch;
-  int received;
-
-  while (remaining > 0) {
-    ESP_LOGI("server", "Remaining size : %d", remaining);
-    /* Receive the file part by part into a buffer */
-    if ((received =
-             httpd_req_recv(req, buf, MIN(remaining, SCRATCH_BUFSIZE))) <= 0) {
-      if (received == HTTPD_SOCK_ERR_TIMEOUT) {
-        /* Retry if timeout occurred */
-        continue;
-      }
+static bool otp_check(httpd_req_t *req) {
+  char otp_header[11];
+  uint32_t num;
+
+  /* Every request after the login carries the OTP it returned, none is
+   * valid before the first login */
+  return otp != 0 &&
+         httpd_req_get_hdr_value_str(req, "Otp", otp_header,
+                                     sizeof(otp_header)) == ESP_OK &&
+         form_parse_uint(otp_header, UINT32_MAX, &num) && num == otp;
+}
 
-      ESP_LOGE("server", "File reception failed!");
-      /* Respond with 500 Internal Server Error */
-      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR,
-                          "Failed to receive file");
-      return NULL;
-    }
+static bool metrics_token_check(httpd_req_t *req) {
+  static const char expected[] = "Bearer " CONFIG_SERVER_METRICS_TOKEN;
+  char auth[sizeof(expected)];
+  uint8_t diff = 0;
 
-    remaining -= received;
+  /* The scrapes list the clients MACs, so none is served without a token */
+  if (sizeof(CONFIG_SERVER_METRICS_TOKEN) == 1 ||
+      httpd_req_get_hdr_value_str(req, "Authorization", auth,
+                                  sizeof(auth)) != ESP_OK ||
+      strlen(auth) != sizeof(expected) - 1) {
+    return false;
   }
 
-  /* Truncate the response string */
-  buf[req->content_len] = '\0';
+  /* Compared in constant time */
+  for (size_t i = 0; i < sizeof(expected) - 1; i++) {
+    diff |= auth[i] ^ expected[i];
+  }
+
+  return diff == 0;
+}
+
+static bool settings_key_check(const char *key) {
+  static const char *const keys[] = {"clients", "time", "ssid", "rate",
+                                     "burst"};
 
-  return buf;
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    if (!strcmp(key, keys[i])) {
+      return true;
+    }
+  }
+
+  return false;
 }
 
 static esp_err_t settings_save_handler(httpd_req_t *req) {
-  char otp_header[11];
+  if (!otp_check(req)) {
+    return httpd_resp_send_500(req);
+  }
+
+  /* Parsed as it is received, the fields not sent keep their value */
+  char key[16];
+  char value[sizeof(settings.data.ssid)];
+  settings_data_t data = settings.data;
+  uint32_t num = 0;
+  form_t form;
+  esp_err_t ret = form_begin(&form, req, SERVER_SETTINGS_BODY_MAX);
+
+  while (ret == ESP_OK) {
+    ret = form_next(&form, key, sizeof(key), value, sizeof(value));
+
+    if (ret != ESP_OK) {
+      /* Oversize pairs and bad escapes only fail the request for the
+       * settings keys, a truncated key is longer than any of them */
+      if ((ret == ESP_ERR_INVALID_SIZE || ret == ESP_ERR_INVALID_ARG) &&
+          !settings_key_check(key)) {
+        ret = ESP_OK;
+      }
+    } else if (!strcmp(key, "clients")) {
+      ret = form_parse_uint(value, 15, &num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+      data.clients_num = num;
+    } else if (!strcmp(key, "time")) {
+      ret = form_parse_uint(value, UINT16_MAX, &num) && num > 0
+                ? ESP_OK
+                : ESP_ERR_INVALID_ARG;
+      data.time = num;
+    } else if (!strcmp(key, "ssid")) {
+      ret = strlen(value) > 4 ? ESP_OK : ESP_ERR_INVALID_ARG;
+      strcpy(data.ssid, value);
+    } else if (!strcmp(key, "rate")) {
+      /* The rate limit is optional, 0 disables it */
+      ret = form_parse_uint(value, UINT16_MAX, &num) ? ESP_OK
+                                                     : ESP_ERR_INVALID_ARG;
+      data.rate = num;
+    } else if (!strcmp(key, "burst")) {
+      ret = form_parse_uint(value, UINT16_MAX, &num) ? ESP_OK
+                                                     : ESP_ERR_INVALID_ARG;
+      data.burst = num;
+    }
+  }
 
-  if (httpd_req_get_hdr_value_str(req, "Otp", otp_header, sizeof(otp_header)) ==
-      ESP_OK) {
-    if (otp == (uint32_t)strtoul(otp_header, NULL, 10)) {
-      /* Get response */
-      char *buf = read_http_response(req);
+  if (ret != ESP_ERR_NOT_FOUND) {
+    ESP_LOGW(TAG, "Invalid settings request: %s", esp_err_to_name(ret));
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid settings");
+  }
 
-      settings_t new_settings;
-      sscanf(buf, "%hhu,%hu,%31s", &new_settings.data.clients_num,
-             &new_settings.data.time, new_settings.data.ssid);
+  /* Write the new data in EEPROM */
+  settings_set_ssid(&settings, data.ssid);
+  settings_set_clients(&settings, data.clients_num);
+  settings_set_time(&settings, data.time);
+  settings_set_limit(&settings, data.rate, data.burst);
 
-      printf("buffer:%d,%d,%s\r\n", settings.data.clients_num,
-             settings.data.time, settings.data.ssid);
+  if (!settings_save(&settings)) {
+    return httpd_resp_send_500(req);
+  }
 
-      /* Write the new data in EEPROM */
-      if (strlen(new_settings.data.ssid) > 4) {
-        strcpy(settings.data.ssid, new_settings.data.ssid);
-      }
+  /* Process the response */
+  const char *resp_str = "success";
+  httpd_resp_set_type(req, "text/plain");
+  httpd_resp_send(req, resp_str, strlen(resp_str));
+  reset_device(NULL);
 
-      if (new_settings.data.clients_num <= 15) {
-        settings.data.clients_num = new_settings.data.clients_num;
-      }
+  return ESP_OK;
+}
+
+static esp_err_t settings_load_handler(httpd_req_t *req) {
+  if (otp_check(req)) {
+    char resp_str[128];
+    sprintf(resp_str, "%d,%d,%s,%d,%d", settings.data.clients_num,
+            settings.data.time, settings.data.ssid, settings.data.rate,
+            settings.data.burst);
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_send(req, resp_str, strlen(resp_str));
+  } else {
+    httpd_resp_send_500(req);
+  }
+
+  /* Respond with an empty chunk to signal HTTP response completion */
+  httpd_resp_send_chunk(req, NULL, 0);
+  return ESP_OK;
+}
+
+static esp_err_t dns_stats_handler(httpd_req_t *req) {
+  if (!otp_check(req)) {
+    return httpd_resp_send_500(req);
+  }
+
+  char line[96];
+  httpd_resp_set_type(req, "text/plain");
 
-      if (new_settings.data.time > 0) {
-        settings.data.time = new_settings.data.time;
+  snprintf(line, sizeof(line), "blocked,%lu\nforwarded,%lu\ncache,%lu,%lu\n",
+           dns.blocked, dns.forwarded, dns_cache.hits, dns_cache.misses);
+  httpd_resp_sendstr_chunk(req, line);
+
+  /* One line per upstream: address, latency, queries, answers, wins and
+   * failures */
+  const dns_upstream_t *upstream;
+
+  for (uint8_t i = 0; (upstream = dns_get_upstream(&dns, i)) != NULL; i++) {
+    snprintf(line, sizeof(line),
+             "upstream," IPSTR ",%lu.%03lu,%lu,%lu,%lu,%lu\n",
+             IP2STR((esp_ip4_addr_t *)&upstream->addr.sin_addr),
+             upstream->ewma_us / 1000, upstream->ewma_us % 1000,
+             upstream->queries, upstream->answers, upstream->wins,
+             upstream->failures);
+    httpd_resp_sendstr_chunk(req, line);
+  }
+
+  return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+static esp_err_t event_stats_handler(httpd_req_t *req) {
+  if (!otp_check(req)) {
+    return httpd_resp_send_500(req);
+  }
+
+  char line[320];
+  httpd_resp_set_type(req, "text/plain");
+
+  /* One line per queue: name, length, high-water mark, drops and coalesced
+   * events */
+  const event_queue_t *queue;
+
+  for (uint8_t i = 0; (queue = event_get_queue(i)) != NULL; i++) {
+    snprintf(line, sizeof(line), "queue,%s,%u,%u,%lu,%lu\n", queue->name,
+             queue->len, queue->high_water, (uint32_t)queue->drops,
+             (uint32_t)queue->coalesced);
+    httpd_resp_sendstr_chunk(req, line);
+  }
+
+  static const char *const hop_names[EVENT_HOP_MAX] = {"trg", "rsp", "cmd"};
+  static const int hop_nums[EVENT_HOP_MAX] = {EVENT_TRG_MAX, EVENT_RSP_MAX,
+                                              EVENT_CMD_MAX};
+
+  /* One line per hop and event number seen: queue latency counts in log2
+   * bins of us */
+  for (int hop = 0; hop < EVENT_HOP_MAX; hop++) {
+    const event_hist_t *hist;
+
+    for (int num = 0; num < hop_nums[hop]; num++) {
+      if ((hist = event_get_hist(hop, num)) == NULL) {
+        continue;
       }
 
-      if (settings_save(&settings)) {
-        /* Process the response */
-        const char *resp_str = "success";
-        httpd_resp_set_type(req, "text/plain");
-        httpd_resp_send(req, resp_str, strlen(resp_str));
-        reset_device(NULL);
+      int len = snprintf(line, sizeof(line), "%s,%d", hop_names[hop], num);
+      uint32_t total = 0;
+
+      for (uint8_t i = 0; i < EVENT_HIST_BINS; i++) {
+        len += snprintf(line + len, sizeof(line) - len, ",%lu", hist->bin[i]);
+        total += hist->bin[i];
       }
 
-    } else {
-      httpd_resp_send_500(req);
+      if (total) {
+        line[len++] = '\n';
+        httpd_resp_send_chunk(req, line, len);
+      }
     }
   }
 
-  /* Respond with an empty chunk to signal HTTP response completion */
-  httpd_resp_set_hdr(req, "Connection", "close");
-  httpd_resp_send_chunk(req, NULL, 0);
-  return ESP_OK;
+  return httpd_resp_sendstr_chunk(req, NULL);
 }
 
-static esp_err_t settings_load_handler(httpd_req_t *req) {
-  /* Check the OTP received */
-  char otp_header[11];
+static esp_err_t traffic_handler(httpd_req_t *req) {
+  if (!otp_check(req)) {
+    return httpd_resp_send_500(req);
+  }
 
-  if (httpd_req_get_hdr_value_str(req, "Otp", otp_header, sizeof(otp_header)) ==
-      ESP_OK) {
-    if (otp == (uint32_t)strtoul(otp_header, NULL, 10)) {
-      char resp_str[128];
-      sprintf(resp_str, "%d,%d,%s", settings.data.clients_num,
-              settings.data.time, settings.data.ssid);
-      httpd_resp_set_type(req, "text/plain");
-      httpd_resp_send(req, resp_str, strlen(resp_str));
-    } else {
-      httpd_resp_send_500(req);
+  char line[160];
+  traffic_client_t client;
+  httpd_resp_set_type(req, "text/plain");
+
+  /* One line per client: MAC, address, then bytes, packets, bit rate and
+   * packets over the rate limit received and sent by the client */
+  for (uint8_t i = 0; traffic_get_client(&traffic, i, &client); i++) {
+    snprintf(line, sizeof(line),
+             "client," MACSTR
+             ",%u.%u.%u.%u,%llu,%llu,%llu,%llu,%lu,%lu,%llu,%llu\n",
+             MAC2STR(client.mac), traffic.subnet[0], traffic.subnet[1],
+             traffic.subnet[2], client.octet, client.bytes[TRAFFIC_DIR_RX],
+             client.bytes[TRAFFIC_DIR_TX], client.packets[TRAFFIC_DIR_RX],
+             client.packets[TRAFFIC_DIR_TX], client.bps[TRAFFIC_DIR_RX],
+             client.bps[TRAFFIC_DIR_TX], client.drops[TRAFFIC_DIR_RX],
+             client.drops[TRAFFIC_DIR_TX]);
+    httpd_resp_sendstr_chunk(req, line);
+  }
+
+  return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+static esp_err_t health_handler(httpd_req_t *req) {
+  if (!otp_check(req)) {
+    return httpd_resp_send_500(req);
+  }
+
+  char line[160];
+  health_sample_t sample;
+  uint32_t num;
+  uint32_t seq = health_get_first(&health, &num);
+  httpd_resp_set_type(req, "text/csv");
+  httpd_resp_sendstr_chunk(
+      req, "time,napt_tcp,napt_udp,napt_icmp,napt_evictions,ip_forwarded,"
+           "ip_dropped,dram_free,dram_largest,psram_free,psram_largest\n");
+
+  /* Oldest sample first */
+  for (uint32_t end = seq + num; seq != end; seq++) {
+    if (!health_get(&health, seq, &sample)) {
+      continue;
     }
+
+    snprintf(line, sizeof(line), "%lu,%u,%u,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+             sample.time, sample.napt_tcp, sample.napt_udp, sample.napt_icmp,
+             sample.napt_evictions, sample.ip_forwarded, sample.ip_dropped,
+             sample.dram_free, sample.dram_largest, sample.psram_free,
+             sample.psram_largest);
+    httpd_resp_sendstr_chunk(req, line);
   }
 
-  /* Respond with an empty chunk to signal HTTP response completion */
-  httpd_resp_set_hdr(req, "Connection", "close");
-  httpd_resp_send_chunk(req, NULL, 0);
-  return ESP_OK;
+  return httpd_resp_sendstr_chunk(req, NULL);
 }
 
-static esp_err_t login_handler(httpd_req_t *req) {
-  /* Get response */
-  char *password = read_http_response(req);
-
-  if (password) {
-    /* Check if the password is correct */
-    char password_auth[7];
-    sprintf(password_auth, "%02X%02X%02X", mac_addr[3], mac_addr[4],
-            mac_addr[5]);
-
-    if (!strcmp(password, password_auth)) {
-      otp = esp_random();
-      char resp_str[128];
-      sprintf(resp_str, "%lu", otp);
-      httpd_resp_set_type(req, "text/plain");
-      httpd_resp_send(req, resp_str, strlen(resp_str));
-    } else {
-      httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, NULL);
+static esp_err_t health_bin_handler(httpd_req_t *req) {
+  if (!otp_check(req)) {
+    return httpd_resp_send_500(req);
+  }
+
+  health_header_t header;
+  health_sample_t sample[8];
+  uint32_t num;
+  uint32_t seq = health_get_first(&health, &num);
+  uint8_t len = 0;
+
+  /* Header and then the raw samples, sent a few at once */
+  health_get_header(&health, &header, num);
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_send_chunk(req, (const char *)&header, sizeof(header));
+
+  for (uint32_t end = seq + num; seq != end; seq++) {
+    if (!health_get(&health, seq, &sample[len])) {
+      /* Overwritten meanwhile, the header count must still hold */
+      memset(&sample[len], 0, sizeof(health_sample_t));
     }
 
-  } else {
-    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    if (++len == sizeof(sample) / sizeof(sample[0]) || seq + 1 == end) {
+      httpd_resp_send_chunk(req, (const char *)sample,
+                            len * sizeof(health_sample_t));
+      len = 0;
+    }
   }
 
-  /* Respond with an empty chunk to signal HTTP response completion */
-  httpd_resp_set_hdr(req, "Connection", "close");
-  httpd_resp_send_chunk(req, NULL, 0);
-  return ESP_OK;
+  return httpd_resp_send_chunk(req, NULL, 0);
 }
 
-static esp_err_t spiffs_init(const char *base_path) {
-  ESP_LOGI("server", "Initializing SPIFFS");
+static esp_err_t metrics_handler(httpd_req_t *req) {
+  const event_queue_t *queue;
+  traffic_client_t client;
+  health_sample_t sample;
+  metrics_t metrics;
+  size_t size;
 
-  esp_err_t ret = ESP_OK;
+  if (!metrics_token_check(req)) {
+    return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, NULL);
+  }
 
-  esp_vfs_spiffs_conf_t conf = {.base_path = base_path,
-                                .partition_label = NULL,
-                                .max_files = 5,
-                                .format_if_mount_failed = false};
+  /* Rendered in the connection buffer, sent every time it fills up */
+  char *buf = server_get_scratch(req, &size);
 
-  /* Register SPIFFS file system */
-  ret = esp_vfs_spiffs_register(&conf);
+  if (buf == NULL) {
+    return httpd_resp_send_500(req);
+  }
+
+  metrics_begin(&metrics, req, buf, size);
+
+  metrics_header(&metrics, "nearfi_uptime_seconds", METRICS_GAUGE,
+                 "Time since boot.");
+  metrics_printf(&metrics, "nearfi_uptime_seconds %lld\n",
+                 esp_timer_get_time() / 1000000);
+
+  /* Events queues */
+  metrics_header(&metrics, "nearfi_event_queue_depth", METRICS_GAUGE,
+                 "Events waiting in the queue.");
+
+  for (uint8_t i = 0; (queue = event_get_queue(i)) != NULL; i++) {
+    metrics_printf(&metrics, "nearfi_event_queue_depth{queue=\"%s\"} %u\n",
+                   queue->name, uxQueueMessagesWaiting(queue->handle));
+  }
+
+  metrics_header(&metrics, "nearfi_event_queue_high_water", METRICS_GAUGE,
+                 "Most events ever waiting in the queue.");
+
+  for (uint8_t i = 0; (queue = event_get_queue(i)) != NULL; i++) {
+    metrics_printf(&metrics,
+                   "nearfi_event_queue_high_water{queue=\"%s\"} %u\n",
+                   queue->name, queue->high_water);
+  }
+
+  metrics_header(&metrics, "nearfi_event_queue_drops_total", METRICS_COUNTER,
+                 "Events dropped with the queue full.");
+
+  for (uint8_t i = 0; (queue = event_get_queue(i)) != NULL; i++) {
+    metrics_printf(&metrics,
+                   "nearfi_event_queue_drops_total{queue=\"%s\"} %lu\n",
+                   queue->name, atomic_load(&queue->drops));
+  }
+
+  metrics_header(&metrics, "nearfi_event_queue_coalesced_total",
+                 METRICS_COUNTER, "Events merged with a pending one.");
+
+  for (uint8_t i = 0; (queue = event_get_queue(i)) != NULL; i++) {
+    metrics_printf(&metrics,
+                   "nearfi_event_queue_coalesced_total{queue=\"%s\"} %lu\n",
+                   queue->name, atomic_load(&queue->coalesced));
+  }
+
+  /* Clients */
+  metrics_header(&metrics, "nearfi_clients", METRICS_GAUGE,
+                 "Stations connected to the AP.");
+  metrics_printf(&metrics, "nearfi_clients %u\n", clients.num);
+
+  metrics_header(&metrics, "nearfi_client_bytes_total", METRICS_COUNTER,
+                 "Bytes received (rx) and sent (tx) by the client.");
+
+  for (uint8_t i = 0; traffic_get_client(&traffic, i, &client); i++) {
+    metrics_printf(&metrics,
+                   "nearfi_client_bytes_total{mac=\"" MACSTR
+                   "\",dir=\"rx\"} %llu\n"
+                   "nearfi_client_bytes_total{mac=\"" MACSTR
+                   "\",dir=\"tx\"} %llu\n",
+                   MAC2STR(client.mac), client.bytes[TRAFFIC_DIR_RX],
+                   MAC2STR(client.mac), client.bytes[TRAFFIC_DIR_TX]);
+  }
+
+  metrics_header(&metrics, "nearfi_client_drops_total", METRICS_COUNTER,
+                 "Frames of the client dropped by the rate limit or queues.");
+
+  for (uint8_t i = 0; traffic_get_client(&traffic, i, &client); i++) {
+    metrics_printf(&metrics,
+                   "nearfi_client_drops_total{mac=\"" MACSTR
+                   "\",dir=\"rx\"} %llu\n"
+                   "nearfi_client_drops_total{mac=\"" MACSTR
+                   "\",dir=\"tx\"} %llu\n",
+                   MAC2STR(client.mac), client.drops[TRAFFIC_DIR_RX],
+                   MAC2STR(client.mac), client.drops[TRAFFIC_DIR_TX]);
+  }
+
+  /* NAPT, IP and heap from the last health sample, not read here so the
+   * scrapes do not take the stack or heap locks */
+  if (health_get_last(&health, &sample)) {
+    metrics_header(&metrics, "nearfi_napt_entries", METRICS_GAUGE,
+                   "Active NAPT table entries.");
+    metrics_printf(&metrics,
+                   "nearfi_napt_entries{proto=\"tcp\"} %u\n"
+                   "nearfi_napt_entries{proto=\"udp\"} %u\n"
+                   "nearfi_napt_entries{proto=\"icmp\"} %u\n",
+                   sample.napt_tcp, sample.napt_udp, sample.napt_icmp);
+    metrics_header(&metrics, "nearfi_napt_evictions_total", METRICS_COUNTER,
+                   "NAPT entries evicted with the table full.");
+    metrics_printf(&metrics, "nearfi_napt_evictions_total %lu\n",
+                   sample.napt_evictions);
+    metrics_header(&metrics, "nearfi_ip_forwarded_total", METRICS_COUNTER,
+                   "IP datagrams forwarded.");
+    metrics_printf(&metrics, "nearfi_ip_forwarded_total %lu\n",
+                   sample.ip_forwarded);
+    metrics_header(&metrics, "nearfi_ip_dropped_total", METRICS_COUNTER,
+                   "IP datagrams dropped.");
+    metrics_printf(&metrics, "nearfi_ip_dropped_total %lu\n",
+                   sample.ip_dropped);
+    metrics_header(&metrics, "nearfi_heap_free_bytes", METRICS_GAUGE,
+                   "Free heap memory.");
+    metrics_printf(&metrics,
+                   "nearfi_heap_free_bytes{region=\"dram\"} %lu\n"
+                   "nearfi_heap_free_bytes{region=\"psram\"} %lu\n",
+                   sample.dram_free, sample.psram_free);
+    metrics_header(&metrics, "nearfi_heap_largest_free_block_bytes",
+                   METRICS_GAUGE, "Largest free heap block.");
+    metrics_printf(&metrics,
+                   "nearfi_heap_largest_free_block_bytes{region=\"dram\"} "
+                   "%lu\n"
+                   "nearfi_heap_largest_free_block_bytes{region=\"psram\"} "
+                   "%lu\n",
+                   sample.dram_largest, sample.psram_largest);
+  }
+
+  /* Health probe */
+  metrics_header(&metrics, "nearfi_internet_up", METRICS_GAUGE,
+                 "Last health probe reached the Internet.");
+  metrics_printf(&metrics, "nearfi_internet_up %d\n",
+                 atomic_load(&health_online));
+  metrics_header(&metrics, "nearfi_health_probe_rtt_seconds", METRICS_GAUGE,
+                 "TCP handshake time of the last successful health probe.");
+  uint32_t rtt_us = atomic_load(&health_rtt_us);
+  metrics_printf(&metrics, "nearfi_health_probe_rtt_seconds %lu.%06lu\n",
+                 rtt_us / 1000000, rtt_us % 1000000);
+
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+  /* The run time counter ticks in microseconds, the scheduler is only
+   * suspended while the tasks states are copied */
+  static TaskStatus_t tasks[METRICS_TASKS_MAX];
+  UBaseType_t num = uxTaskGetSystemState(tasks, METRICS_TASKS_MAX, NULL);
+  metrics_header(&metrics, "nearfi_task_cpu_seconds_total", METRICS_COUNTER,
+                 "CPU time used by the task.");
+
+  for (UBaseType_t i = 0; i < num; i++) {
+    uint64_t run_time = tasks[i].ulRunTimeCounter;
+    metrics_printf(&metrics,
+                   "nearfi_task_cpu_seconds_total{task=\"%s\"} %llu.%06llu\n",
+                   tasks[i].pcTaskName, run_time / 1000000,
+                   run_time % 1000000);
+  }
+#endif
+
+  return metrics_end(&metrics);
+}
 
-  if (ret != ESP_OK) {
-    if (ret == ESP_FAIL) {
-      ESP_LOGE("server", "Failed to mount or format filesystem");
-    } else if (ret == ESP_ERR_NOT_FOUND) {
-      ESP_LOGE("server", "Failed to find SPIFFS partition");
-    } else {
-      ESP_LOGE("server", "Failed to initialize SPIFFS (%s)",
-               esp_err_to_name(ret));
+static esp_err_t login_handler(httpd_req_t *req) {
+  char key[16];
+  char password[16] = "";
+  form_t form;
+  esp_err_t ret = form_begin(&form, req, SERVER_LOGIN_BODY_MAX);
+
+  /* Get the password field, the rest are ignored */
+  while (ret == ESP_OK) {
+    ret = form_next(&form, key, sizeof(key), password, sizeof(password));
+
+    if (ret == ESP_OK && !strcmp(key, "password")) {
+      break;
     }
 
-    return ret;
+    /* Oversize or badly escaped fields other than the password are skipped
+     * too */
+    if ((ret == ESP_ERR_INVALID_SIZE || ret == ESP_ERR_INVALID_ARG) &&
+        strcmp(key, "password")) {
+      ret = ESP_OK;
+    }
   }
 
-  size_t total = 0, used = 0;
-  ret = esp_spiffs_info(NULL, &total, &used);
   if (ret != ESP_OK) {
-    ESP_LOGE("server", "Failed to get SPIFFS partition information (%s)",
-             esp_err_to_name(ret));
-  } else {
-    ESP_LOGI("server", "Partition size: total: %d, used: %d", total, used);
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
   }
 
-  return ret;
+  /* Check if the password is correct */
+  char password_auth[7];
+  sprintf(password_auth, "%02X%02X%02X", mac_addr[3], mac_addr[4],
+          mac_addr[5]);
+
+  if (strcmp(password, password_auth)) {
+    return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, NULL);
+  }
+
+  /* Zero is kept for no login */
+  do {
+    otp = esp_random();
+  } while (otp == 0);
+
+  char resp_str[11];
+  sprintf(resp_str, "%lu", otp);
+  httpd_resp_set_type(req, "text/plain");
+
+  return httpd_resp_send(req, resp_str, strlen(resp_str));
 }
 
 static void delay_ms(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
@@ -970,38 +1410,61 @@ static esp_err_t app_create_queues(void) {
   ESP_LOGI(TAG, "Creating app queues...");
 
   /* */
-  event_triggers_queue = xQueueCreate(APP_QUEUE_LEN_DEFAULT, sizeof(event_t));
+  event_triggers_queue =
+      event_queue_create("triggers", CONFIG_EVENTS_TRIGGERS_QUEUE_LEN);
 
   if (event_triggers_queue == NULL) {
     return ESP_FAIL;
   }
 
-  event_responses_queue = xQueueCreate(APP_QUEUE_LEN_DEFAULT, sizeof(event_t));
+  event_urgent_queue =
+      event_queue_create("urgent", CONFIG_EVENTS_URGENT_QUEUE_LEN);
+
+  if (event_urgent_queue == NULL) {
+    return ESP_FAIL;
+  }
+
+  /* The triggers manager waits on both triggers lanes */
+  event_triggers_set = xQueueCreateSet(CONFIG_EVENTS_TRIGGERS_QUEUE_LEN +
+                                       CONFIG_EVENTS_URGENT_QUEUE_LEN);
+
+  if (event_triggers_set == NULL ||
+      xQueueAddToSet(event_urgent_queue, event_triggers_set) != pdPASS ||
+      xQueueAddToSet(event_triggers_queue, event_triggers_set) != pdPASS) {
+    return ESP_FAIL;
+  }
+
+  event_responses_queue =
+      event_queue_create("responses", CONFIG_EVENTS_RESPONSES_QUEUE_LEN);
 
   if (event_responses_queue == NULL) {
     return ESP_FAIL;
   }
 
   /**/
-  clients_commands_queue = xQueueCreate(APP_QUEUE_LEN_DEFAULT, sizeof(event_t));
+  clients_commands_queue =
+      event_queue_create("clients", CONFIG_EVENTS_CLIENTS_QUEUE_LEN);
 
   if (clients_commands_queue == NULL) {
     return ESP_FAIL;
   }
 
-  actions_commands_queue = xQueueCreate(APP_QUEUE_LEN_DEFAULT, sizeof(event_t));
+  actions_commands_queue =
+      event_queue_create("actions", CONFIG_EVENTS_COMMANDS_QUEUE_LEN);
 
   if (actions_commands_queue == NULL) {
     return ESP_FAIL;
   }
 
-  alerts_commands_queue = xQueueCreate(APP_QUEUE_LEN_DEFAULT, sizeof(event_t));
+  alerts_commands_queue =
+      event_queue_create("alerts", CONFIG_EVENTS_COMMANDS_QUEUE_LEN);
 
   if (alerts_commands_queue == NULL) {
     return ESP_FAIL;
   }
 
-  network_commands_queue = xQueueCreate(APP_QUEUE_LEN_DEFAULT, sizeof(event_t));
+  network_commands_queue =
+      event_queue_create("network", CONFIG_EVENTS_COMMANDS_QUEUE_LEN);
 
   if (network_commands_queue == NULL) {
     return ESP_FAIL;
@@ -1016,17 +1479,25 @@ static esp_err_t app_create_tasks(void) {
   BaseType_t status;
 
   /**/
-  status = xTaskCreatePinnedToCore(tick_task, "Tick Task",
+  status = xTaskCreatePinnedToCore(health_monitor_task, "Health Monitor Task",
                                    configMINIMAL_STACK_SIZE * 2, NULL,
-                                   APP_TASK_TICK_PRIORITY, NULL, 1);
+                                   APP_TASK_HEALTH_MONITOR_PRIORITY, NULL, 0);
 
   if (status != pdPASS) {
     return ESP_FAIL;
   }
 
-  status = xTaskCreatePinnedToCore(health_monitor_task, "Health Monitor Task",
+  status = xTaskCreatePinnedToCore(traffic_task, "Traffic Task",
                                    configMINIMAL_STACK_SIZE * 2, NULL,
-                                   APP_TASK_HEALTH_MONITOR_PRIORITY, NULL, 0);
+                                   APP_TASK_TRAFFIC_PRIORITY, NULL, 0);
+
+  if (status != pdPASS) {
+    return ESP_FAIL;
+  }
+
+  status = xTaskCreatePinnedToCore(wdt_task, "WDT Task",
+                                   configMINIMAL_STACK_SIZE * 2, NULL,
+                                   APP_TASK_WDT_PRIORITY, &wdt_task_handle, 1);
 
   if (status != pdPASS) {
     return ESP_FAIL;
@@ -1084,28 +1555,37 @@ static esp_err_t app_create_tasks(void) {
   return ESP_OK;
 }
 
+static void wdt_task(void *arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    tpl5010_done(&wdt);
+  }
+}
+
 static void triggers_manager_task(void *arg) {
   BaseType_t status;
-  event_t event;
+  event_t event = {0};
 
   for (;;) {
-    status = xQueueReceive(event_triggers_queue, &event, portMAX_DELAY);
+    status = event_receive_trigger(&event, portMAX_DELAY);
 
     if (status == pdPASS) {
-      event_route(&event, event_trg_map);
+      event_route(&event, event_trg_routes);
+      event_release(&event);
     }
   }
 }
 
 static void responses_manager_task(void *arg) {
   BaseType_t status;
-  event_t event;
+  event_t event = {0};
 
   for (;;) {
-    status = xQueueReceive(event_responses_queue, &event, portMAX_DELAY);
+    status = event_receive(event_responses_queue, &event, portMAX_DELAY);
 
     if (status == pdPASS) {
-      event_route(&event, event_rsp_map);
+      event_route(&event, event_rsp_routes);
+      event_release(&event);
     }
   }
 }
@@ -1146,12 +1626,12 @@ static void alerts_task(void *arg) {
                              NULL);
 
   BaseType_t status;
-  event_t event;
+  event_t event = {0};
 
   ESP_LOGI(TAG, "Alerts Task created! Waiting for incoming commands");
 
   for (;;) {
-    status = xQueueReceive(alerts_commands_queue, &event, pdMS_TO_TICKS(300));
+    status = event_receive(alerts_commands_queue, &event, pdMS_TO_TICKS(300));
 
     if (status == pdPASS) {
       printf("alerts_");
@@ -1232,6 +1712,8 @@ static void alerts_task(void *arg) {
       default:
         break;
       }
+
+      event_release(&event);
     }
 
     fsm_run(&fsm);
@@ -1240,13 +1722,13 @@ static void alerts_task(void *arg) {
 
 static void network_task(void *arg) {
   BaseType_t status;
-  event_t event;
+  event_t event = {0};
   uint8_t reconnect_try = 0;
 
   ESP_LOGI(TAG, "Network Task created! Waiting for incoming commands");
 
   for (;;) {
-    status = xQueueReceive(network_commands_queue, &event, portMAX_DELAY);
+    status = event_receive(network_commands_queue, &event, portMAX_DELAY);
     printf("network_");
     if (status == pdPASS) {
       switch (event.num) {
@@ -1281,18 +1763,20 @@ static void network_task(void *arg) {
       default:
         break;
       }
+
+      event_release(&event);
     }
   }
 }
 
 static void actions_task(void *arg) {
   BaseType_t status;
-  event_t event;
+  event_t event = {0};
 
   ESP_LOGI(TAG, "Actions Task created! Waiting for incoming commands");
 
   for (;;) {
-    status = xQueueReceive(actions_commands_queue, &event, portMAX_DELAY);
+    status = event_receive(actions_commands_queue, &event, portMAX_DELAY);
     printf("actions_");
     if (status == pdPASS) {
       switch (event.num) {
@@ -1322,28 +1806,32 @@ static void actions_task(void *arg) {
         event_send_response(&event, EVENT_RSP_ACTIONS_RESTORE_SUCCESS);
         break;
 
-      case EVENT_CMD_ACTIONS_WDT:
-        printf("wdt\r\n");
-        tpl5010_done(&wdt);
-        break;
-
       default:
         printf("other\r\n");
         break;
       }
+
+      event_release(&event);
     }
   }
 }
 
 static void clients_task(void *arg) {
   BaseType_t status;
-  event_t event;
+  event_t event = {0};
   wifi_sta_list_t sta_list;
+  client_t *client;
+  int64_t now;
+  TickType_t wait;
 
   ESP_LOGI(TAG, "Clients Task created! Waiting for incoming commands");
 
   for (;;) {
-    status = xQueueReceive(clients_commands_queue, &event, portMAX_DELAY);
+    /* Sleep until a command arrives or the nearest session expires */
+    now = esp_timer_get_time();
+    wait = clients_wait_ticks(clients_next_deadline(&clients), now);
+
+    status = event_receive(clients_commands_queue, &event, wait);
     //		printf("clients_");
     if (status == pdPASS) {
       switch (event.num) {
@@ -1353,13 +1841,14 @@ static void clients_task(void *arg) {
         esp_wifi_ap_get_sta_list(&sta_list);
 
         for (uint8_t i = 0; i < sta_list.num; i++) {
-          if (!strncmp((char *)sta_list.sta[i].mac,
-                       (char *)event.data.client.mac, 6)) {
-            if (sta_list.sta[i].rssi <= CONFIG_APP_RSSI_THRESHOLD_JOIN) {
+          if (!memcmp(sta_list.sta[i].mac, event.data.client.mac, 6)) {
+            if (sta_list.sta[i].rssi <= CONFIG_APP_RSSI_THRESHOLD_JOIN ||
+                !clients_add(&clients, event.data.client.mac,
+                             event.data.client.aid,
+                             esp_timer_get_time() +
+                                 settings_get_time(&settings) * 1000000LL)) {
               event_send_response(&event, EVENT_RSP_CLIENTS_ADD_FAIL);
             } else {
-              clients_add(&clients, event.data.client.mac,
-                          event.data.client.aid, settings_get_time(&settings));
               ESP_LOGI(TAG,
                        MACSTR " added to list. "
                               "Clients in list: "
@@ -1394,88 +1883,64 @@ static void clients_task(void *arg) {
         }
         break;
 
-      case EVENT_CMD_CLIENTS_TICK:
-        //				printf("tick\r\n");
-        for (uint8_t i = 0; i < clients.num; i++) {
-          if (--clients.client[i].time == 0) {
-            event.data.client.aid = clients.client[i].aid;
-            strncpy((char *)event.data.client.mac,
-                    (char *)clients.client[i].mac, 6);
-            event_send_response(&event, EVENT_RSP_CLIENTS_TICK_TIMEOUT);
-          }
-        }
-        break;
-
       default:
         printf("other\r\n");
         break;
       }
+
+      event_release(&event);
     }
-  }
-}
 
-static void button_cb(void *arg) {
-  event_t event;
-  event_send_trigger(&event, (event_trg_t)arg, false);
-}
+    /* Only the clients whose deadline passed are visited */
+    now = esp_timer_get_time();
 
-static void wdt_cb(void *arg) {
-  event_t event;
-  event_send_trigger(&event, EVENT_TRG_WDT, true);
-}
+    while ((client = clients_pop_expired(&clients, now)) != NULL) {
+      event.data.client.aid = client->aid;
+      memcpy(event.data.client.mac, client->mac, 6);
 
-static int eeprom_read_cb(uint8_t data_addr, uint8_t *data, uint32_t data_len) {
-  return at24cs0x_read(&eeprom, data_addr, data, data_len);
-}
-static int eeprom_write_cb(uint8_t data_addr, uint8_t *data,
-                           uint32_t data_len) {
-  return at24cs0x_write(&eeprom, data_addr, data, data_len);
+      /* Retry later if the kick could not be queued */
+      if (!event_send_response(&event, EVENT_RSP_CLIENTS_TICK_TIMEOUT)) {
+        clients_add(&clients, client->mac, client->aid, now + 1000000);
+      }
+    }
+  }
 }
 
-static void event_assign_cmds_queue(int first, int last,
-                                    QueueHandle_t cmd_queue) {
-  for (int cmd = first; cmd < last; cmd++) {
-    event_cmd_queues[cmd] = cmd_queue;
+static TickType_t clients_wait_ticks(int64_t deadline, int64_t now) {
+  if (deadline == INT64_MAX) {
+    return portMAX_DELAY;
   }
-}
 
-static void event_register_route(event_cmd_t (*map)[APP_ROUTE_CMD_MAX],
-                                 int event, int cmd1, int cmd2, int cmd3) {
-  map[event][0] = cmd1;
-  map[event][1] = cmd2;
-  map[event][2] = cmd3;
+  if (deadline <= now) {
+    return 0;
+  }
+
+  /* Round up so the task never wakes before the deadline */
+  int64_t ticks = (deadline - now + portTICK_PERIOD_MS * 1000 - 1) /
+                  (portTICK_PERIOD_MS * 1000);
+
+  return ticks < portMAX_DELAY ? (TickType_t)ticks : portMAX_DELAY - 1;
 }
 
-static void event_send_response(event_t *const event, event_rsp_t rsp) {
-  event->num = rsp;
-  xQueueSend(event_responses_queue, event, 0);
+static void button_cb(void *arg) {
+  event_t event = {0};
+  event_send_trigger(&event, (event_trg_t)arg, false);
 }
 
-static void event_send_trigger(event_t *const event, event_rsp_t trg,
-                               bool is_isr) {
+static void wdt_cb(void *arg) {
   BaseType_t higher_priority_task_woken = pdFALSE;
-  event->num = trg;
-
-  if (is_isr) {
-    xQueueSendFromISR(event_triggers_queue, event, &higher_priority_task_woken);
-  } else {
-    xQueueSend(event_triggers_queue, event, 0);
-  }
 
+  /* Straight to the WDT task, the event queues can be full */
+  vTaskNotifyGiveFromISR(wdt_task_handle, &higher_priority_task_woken);
   portYIELD_FROM_ISR(higher_priority_task_woken);
 }
 
-static void event_route(event_t *const event,
-                        event_cmd_t (*map)[APP_ROUTE_CMD_MAX]) {
-  int num = event->num;
-  for (uint8_t i = 0; i < APP_ROUTE_CMD_MAX; i++) {
-    int cmd = map[num][i];
-
-    if (cmd > EVENT_CMD_NO && cmd < EVENT_CMD_MAX) {
-      event->num = cmd;
-      xQueueSend(event_cmd_queues[event->num], event, 0);
-    }
-  }
+static int eeprom_read_cb(uint8_t data_addr, uint8_t *data, uint32_t data_len) {
+  return at24cs0x_read(&eeprom, data_addr, data, data_len);
+}
+static int eeprom_write_cb(uint8_t data_addr, uint8_t *data,
+                           uint32_t data_len) {
+  return at24cs0x_write(&eeprom, data_addr, data, data_len);
 }
 
 static void on_idle_update(void) {
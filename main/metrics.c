@@ -0,0 +1,129 @@
+/**
+ ******************************************************************************
+ * @file           : metrics.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Prometheus text format writer over HTTP chunks
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/* Private macros ------------------------------------------------------------*/
+
+/* External variables --------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum {
+  METRICS_COUNTER = 0,
+  METRICS_GAUGE,
+} metrics_type_t;
+
+/* Writes straight into a caller buffer and sends it as a chunk when full */
+typedef struct {
+  httpd_req_t *req;
+  char *buf;
+  size_t size;
+  size_t len;
+  esp_err_t err; /* First send error, the rest of the output is skipped */
+} metrics_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const char *const metrics_types[] = {"counter", "gauge"};
+
+/* Private function prototypes -----------------------------------------------*/
+static void metrics_flush(metrics_t *const me);
+
+/* Exported functions definitions --------------------------------------------*/
+void metrics_begin(metrics_t *const me, httpd_req_t *req, char *buf,
+                   size_t size) {
+  me->req = req;
+  me->buf = buf;
+  me->size = size;
+  me->len = 0;
+  me->err = ESP_OK;
+
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+}
+
+void metrics_printf(metrics_t *const me, const char *fmt, ...) {
+  va_list args;
+
+  /* Retried once in an empty buffer when the line does not fit */
+  for (uint8_t i = 0; i < 2 && me->err == ESP_OK; i++) {
+    va_start(args, fmt);
+    int len = vsnprintf(me->buf + me->len, me->size - me->len, fmt, args);
+    va_end(args);
+
+    if (len >= 0 && (size_t)len < me->size - me->len) {
+      me->len += len;
+      return;
+    }
+
+    if (me->len == 0) {
+      /* Longer than the whole buffer, dropped */
+      return;
+    }
+
+    metrics_flush(me);
+  }
+}
+
+void metrics_header(metrics_t *const me, const char *name, metrics_type_t type,
+                    const char *help) {
+  metrics_printf(me, "# HELP %s %s\n# TYPE %s %s\n", name, help, name,
+                 metrics_types[type]);
+}
+
+esp_err_t metrics_end(metrics_t *const me) {
+  metrics_flush(me);
+
+  if (me->err != ESP_OK) {
+    return me->err;
+  }
+
+  return httpd_resp_send_chunk(me->req, NULL, 0);
+}
+
+/* Private function definitions ----------------------------------------------*/
+static void metrics_flush(metrics_t *const me) {
+  if (me->len && me->err == ESP_OK) {
+    me->err = httpd_resp_send_chunk(me->req, me->buf, me->len);
+  }
+
+  me->len = 0;
+}
+
+/***************************** END OF FILE ************************************/
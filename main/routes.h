@@ -0,0 +1,104 @@
+/**
+  ******************************************************************************
+  * @file           : routes.h
+  * @author         : Mauricio Barroso Benavides
+  * @date           : Oct, 2026
+  * @brief          : Events to commands routes
+  ******************************************************************************
+  * @attention
+  *
+  * MIT License
+  *
+  * Copyright (c) 2026 Mauricio Barroso Benavides
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to
+  * deal in the Software without restriction, including without limitation the
+  * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+  * sell copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in
+  * all copies or substantial portions of the Software.
+  * 
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  * IN THE SOFTWARE.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef ROUTES_H_
+#define ROUTES_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "typedefs.h"
+
+/* Exported Macros -----------------------------------------------------------*/
+/* Triggers to commands routes: X(trigger, commands...) */
+#define EVENT_TRG_ROUTES(X)                                                    \
+	X(EVENT_TRG_BUTTON_SHORT, EVENT_CMD_ACTIONS_RESET)                         \
+	X(EVENT_TRG_BUTTON_MEDIUM, EVENT_CMD_NETWORK_OTA)                          \
+	X(EVENT_TRG_BUTTON_LONG, EVENT_CMD_ACTIONS_RESTORE)                        \
+	X(EVENT_TRG_WIFI_AP_STACONNECTED, EVENT_CMD_CLIENTS_ADD)                   \
+	X(EVENT_TRG_WIFI_AP_STADISCONNECTED, EVENT_CMD_CLIENTS_REMOVE)             \
+	X(EVENT_TRG_WIFI_STA_DISCONNECTED, EVENT_CMD_NETWORK_RECONNECT,            \
+	  EVENT_CMD_ALERTS_IDLE_DISCONNECTED)                                      \
+	X(EVENT_TRG_PROV_START, EVENT_CMD_ALERTS_PROCESS_PROV)                     \
+	X(EVENT_TRG_PROV_END, EVENT_CMD_ACTIONS_RESET)                             \
+	X(EVENT_TRG_PROV_FAIL, EVENT_CMD_ACTIONS_RESTORE)                          \
+	X(EVENT_TRG_HEALTH_INTERNET, EVENT_CMD_ALERTS_IDLE_ONLINE)                 \
+	X(EVENT_TRG_HEALTH_NO_INTERNET, EVENT_CMD_ALERTS_IDLE_OFFLINE)             \
+	X(EVENT_TRG_IP_GOT, EVENT_CMD_ALERTS_IDLE_ONLINE)
+
+/* Responses to commands routes: X(response, commands...) */
+#define EVENT_RSP_ROUTES(X)                                                    \
+	X(EVENT_RSP_ACTIONS_RESTORE_SUCCESS, EVENT_CMD_ACTIONS_RESET)              \
+	X(EVENT_RSP_ACTIONS_RESTORE_FAIL, EVENT_CMD_ALERTS_SIGNAL_FAIL)            \
+	X(EVENT_RSP_NETWORK_OTA_START, EVENT_CMD_ALERTS_PROCESS_OTA)               \
+	X(EVENT_RSP_NETWORK_OTA_SUCCESS, EVENT_CMD_ALERTS_PROCESS_END,             \
+	  EVENT_CMD_ALERTS_SIGNAL_SUCCESS, EVENT_CMD_ACTIONS_RESET)                \
+	X(EVENT_RSP_NETWORK_OTA_FAIL, EVENT_CMD_ALERTS_PROCESS_END,                \
+	  EVENT_CMD_ALERTS_SIGNAL_FAIL)                                            \
+	X(EVENT_RSP_NETWORK_OTA_TIMEOUT, EVENT_CMD_ALERTS_PROCESS_END,             \
+	  EVENT_CMD_ALERTS_SIGNAL_WARNING)                                         \
+	X(EVENT_RSP_NETWORK_RECONNECT_TIMEOUT, EVENT_CMD_ALERTS_SIGNAL_WARNING,    \
+	  EVENT_CMD_ACTIONS_RESET)                                                 \
+	X(EVENT_RSP_CLIENTS_ADD_SUCCESS, EVENT_CMD_ALERTS_SIGNAL_SUCCESS)          \
+	X(EVENT_RSP_CLIENTS_ADD_FAIL, EVENT_CMD_NETWORK_DEAUTH)                    \
+	X(EVENT_RSP_CLIENTS_ADD_FULL, EVENT_CMD_ALERTS_IDLE_FULL)                  \
+	X(EVENT_RSP_CLIENTS_REMOVE_EMPTY, EVENT_CMD_ALERTS_IDLE_NO_FULL)           \
+	X(EVENT_RSP_CLIENTS_REMOVE_AVAILABLE, EVENT_CMD_ALERTS_IDLE_NO_FULL)       \
+	X(EVENT_RSP_CLIENTS_TICK_TIMEOUT, EVENT_CMD_NETWORK_DEAUTH)
+
+/* Commands ranges and the queue of the task that runs them:
+ * X(first, last, queue) */
+#define EVENT_CMD_QUEUES(X)                                                    \
+	X(EVENT_CMD_ALERTS_IDLE_ONLINE, EVENT_CMD_ALERTS_MAX,                      \
+	  alerts_commands_queue)                                                   \
+	X(EVENT_CMD_NETWORK_OTA, EVENT_CMD_NETWORK_MAX, network_commands_queue)    \
+	X(EVENT_CMD_CLIENTS_ADD, EVENT_CMD_CLIENTS_MAX, clients_commands_queue)    \
+	X(EVENT_CMD_ACTIONS_RESET, EVENT_CMD_ACTIONS_MAX, actions_commands_queue)
+
+/* Exported typedef ----------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ROUTES_H_ */
+
+/***************************** END OF FILE ************************************/
@@ -37,63 +37,96 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "esp_http_server.h"
-#include "esp_event.h"
-#include "esp_vfs.h"
 #include "esp_err.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
-#include "esp_vfs.h"
-#include "esp_spiffs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "assets.h"
 
 /* Private macros ------------------------------------------------------------*/
-#define FILE_PATH_MAX				(ESP_VFS_PATH_MAX + \
-		                            CONFIG_SPIFFS_OBJ_NAME_LEN )
 #define SCRATCH_BUFSIZE				2048
-#define IS_FILE_EXT(filename, ext) \
-    (strcasecmp(&filename[strlen(filename) - sizeof(ext) + 1], ext) == 0)
-#define MIN(a,b)					 ((a) < (b) ? (a) : (b))
+
+/* One scratch buffer per open connection, kept while it is alive */
+#define SERVER_SOCKETS_MAX			CONFIG_SERVER_MAX_SOCKETS
+#define SERVER_URI_HANDLERS_MAX		16
+
+/* Workers running the slow handlers off the HTTP server task */
+#define SERVER_ASYNC_WORKERS		CONFIG_SERVER_ASYNC_WORKERS
+#define SERVER_ASYNC_STACK_SIZE		(configMINIMAL_STACK_SIZE * 4)
+
+/* Web assets cache lifetime, the pages are revalidated on each load */
+#define SERVER_ASSETS_MAX_AGE		"public, max-age=604800"
 
 /* External variables --------------------------------------------------------*/
 
 /* Private typedef -----------------------------------------------------------*/
 typedef esp_err_t (*server_uri_handler_t)(httpd_req_t *r);
 
-struct file_server_data {
-    /* Base path of file storage */
-    char base_path[ESP_VFS_PATH_MAX + 1];
-
-    /* Scratch buffer for temporary storage during file transfer */
-    char scratch[SCRATCH_BUFSIZE];
-};
+typedef struct {
+    httpd_req_t *req; /* Copy owned by the worker until it completes */
+    server_uri_handler_t handler;
+} server_async_req_t;
 
 /* Private variables ---------------------------------------------------------*/
-static struct file_server_data *server_data = NULL;
+static const assets_t *server_assets = NULL;
+static char *server_buffers = NULL;
+static QueueHandle_t server_buffers_free = NULL;
+static QueueHandle_t server_async_queue = NULL;
 static httpd_handle_t server = NULL;
 
 /* Private function prototypes -----------------------------------------------*/
-static esp_err_t download_get_handler(httpd_req_t *req);
-static const char* get_path_from_uri(char *dest, const char *base_path,
-		const char *uri, size_t dest_size);
-static esp_err_t set_content_type_from_file(httpd_req_t *req,
-		const char *filename);
+static esp_err_t asset_get_handler(httpd_req_t *req);
+static void server_buffer_release(void *ctx);
+static esp_err_t server_uri_register(const char *uri, httpd_method_t method,
+		server_uri_handler_t uri_handler, void *ctx);
+static esp_err_t server_async_handler(httpd_req_t *req);
+static void server_async_task(void *arg);
 
 /* Exported functions definitions --------------------------------------------*/
-esp_err_t server_init(const char *base_path)
+esp_err_t server_init(const assets_t *assets)
 {
-    if (server_data) {
+    if (server_buffers) {
         ESP_LOGE("server", "File server already started");
         return ESP_ERR_INVALID_STATE;
     }
 
-    /* Allocate memory for server data */
-    server_data = calloc(1, sizeof(struct file_server_data));
-    if (!server_data) {
+    /* Allocate the connections buffers, from PSRAM when available */
+    server_buffers = heap_caps_malloc(SERVER_SOCKETS_MAX * SCRATCH_BUFSIZE,
+            MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+
+    if (server_buffers == NULL) {
+        server_buffers = heap_caps_malloc(SERVER_SOCKETS_MAX * SCRATCH_BUFSIZE,
+                MALLOC_CAP_DEFAULT);
+    }
+
+    server_buffers_free = xQueueCreate(SERVER_SOCKETS_MAX, sizeof(char *));
+
+    /* A request waiting for a worker holds its socket, so there are never
+     * more than the open sockets */
+    server_async_queue = xQueueCreate(SERVER_SOCKETS_MAX,
+            sizeof(server_async_req_t));
+
+    if (server_buffers == NULL || server_buffers_free == NULL ||
+        server_async_queue == NULL) {
         ESP_LOGE("server", "Failed to allocate memory for server data");
+        heap_caps_free(server_buffers);
+        server_buffers = NULL;
         return ESP_ERR_NO_MEM;
     }
-    strlcpy(server_data->base_path, base_path,
-            sizeof(server_data->base_path));
+
+    for (uint8_t i = 0; i < SERVER_SOCKETS_MAX; i++) {
+        char *buf = server_buffers + i * SCRATCH_BUFSIZE;
+        xQueueSend(server_buffers_free, &buf, 0);
+    }
+
+    /* The web assets are served from the mapped partition, no file system */
+    server_assets = assets;
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
 
@@ -101,6 +134,22 @@ esp_err_t server_init(const char *base_path)
      * allow the same handler to respond to multiple different
      * target URIs which match the wildcard scheme */
     config.uri_match_fn = httpd_uri_match_wildcard;
+    config.max_uri_handlers = SERVER_URI_HANDLERS_MAX;
+
+    /* Serve several clients at once and reuse their connections, the least
+     * recently used one is closed to accept a new one when all are taken */
+    config.max_open_sockets = SERVER_SOCKETS_MAX;
+    config.lru_purge_enable = true;
+    config.keep_alive_enable = true;
+
+    for (uint8_t i = 0; i < SERVER_ASYNC_WORKERS; i++) {
+        if (xTaskCreatePinnedToCore(server_async_task, "HTTP Worker Task",
+                SERVER_ASYNC_STACK_SIZE, NULL, config.task_priority, NULL,
+                tskNO_AFFINITY) != pdPASS) {
+            ESP_LOGE("server", "Failed to create HTTP worker task");
+            return ESP_FAIL;
+        }
+    }
 
     ESP_LOGI("server", "Starting HTTP Server on port: '%d'", config.server_port);
     esp_err_t err = httpd_start(&server, &config);
@@ -109,152 +158,169 @@ esp_err_t server_init(const char *base_path)
         return ESP_FAIL;
     }
 
-    /* URI handler to get file system files */
-    httpd_uri_t get_file = {
+    /* URI handler to get the web assets */
+    httpd_uri_t get_asset = {
         .uri       = "/*",
         .method    = HTTP_GET,
-        .handler   = download_get_handler,
-        .user_ctx  = server_data
+        .handler   = asset_get_handler,
+        .user_ctx  = NULL
     };
-    httpd_register_uri_handler(server, &get_file);
+    httpd_register_uri_handler(server, &get_asset);
 
     return ESP_OK;
 }
 
 esp_err_t server_uri_handler_add(const char *uri, httpd_method_t method,
 		server_uri_handler_t uri_handler)
+{
+	return server_uri_register(uri, method, uri_handler, NULL);
+}
+
+esp_err_t server_uri_handler_add_async(const char *uri,
+		httpd_method_t method, server_uri_handler_t uri_handler)
+{
+	/* Run by a worker, the HTTP server task goes on serving the rest. The
+	 * handler gets a copy of the request, it must not take a connection
+	 * buffer with server_get_scratch() as the server never frees it */
+	return server_uri_register(uri, method, server_async_handler,
+			(void *)uri_handler);
+}
+
+char *server_get_scratch(httpd_req_t *req, size_t *size)
+{
+	/* Taken from the pool on the first request of the connection and given
+	 * back when it is closed. Only for the synchronous handlers, the session
+	 * context set on an async copy is not kept by the server */
+	if (req->sess_ctx == NULL) {
+		char *buf;
+
+		if (xQueueReceive(server_buffers_free, &buf, 0) != pdPASS) {
+			ESP_LOGW("server", "No connection buffer available");
+			return NULL;
+		}
+
+		req->sess_ctx = buf;
+		req->free_ctx = server_buffer_release;
+	}
+
+	*size = SCRATCH_BUFSIZE;
+
+	return req->sess_ctx;
+}
+
+/* Private function definitions ----------------------------------------------*/
+static esp_err_t server_uri_register(const char *uri, httpd_method_t method,
+		server_uri_handler_t uri_handler, void *ctx)
 {
 	httpd_uri_t uri_cfg = {
 			.uri = uri,
 			.method = method,
 			.handler = uri_handler,
-			.user_ctx = server_data
+			.user_ctx = ctx
+	};
+	httpd_uri_t get_asset = {
+			.uri = "/*",
+			.method = HTTP_GET,
+			.handler = asset_get_handler,
+			.user_ctx = NULL
 	};
 
-	return httpd_register_uri_handler(server, &uri_cfg);
-}
+	/* The handlers are matched in order, the assets wildcard goes last */
+	httpd_unregister_uri_handler(server, get_asset.uri, get_asset.method);
+	esp_err_t ret = httpd_register_uri_handler(server, &uri_cfg);
+	httpd_register_uri_handler(server, &get_asset);
 
-/* Private function definitions ----------------------------------------------*/
-static esp_err_t download_get_handler(httpd_req_t *req)
-{
-    char filepath[FILE_PATH_MAX];
-    FILE *fd = NULL;
-    struct stat file_stat;
-    char *base_path = ((struct file_server_data*)req->user_ctx)->base_path;
-    const char *filename;
-
-    /* Get the file name fron the URI */
-	filename = get_path_from_uri(filepath, base_path, req->uri,
-			sizeof(filepath));
-
-	/* Return index.html when URI is empty */
-	if (!strcmp(filename, "/")) {
-		filename = get_path_from_uri(filepath, base_path, "/index.html",
-				sizeof(filepath));
+	if (ret != ESP_OK) {
+		ESP_LOGE("server", "Failed to register %s handler: %s", uri,
+				esp_err_to_name(ret));
 	}
 
-	/* Check the file name */
-    if (!filename) {
-        ESP_LOGE("server", "Filename is too long");
-        /* Respond with 500 Internal Server Error */
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Filename too long");
-        return ESP_FAIL;
-    }
+	return ret;
+}
 
-    if (stat(filepath, &file_stat) == -1) {
-        ESP_LOGE("server", "Failed to stat file : %s", filepath);
-        /* Respond with 404 Not Found */
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File does not exist");
-        return ESP_FAIL;
-    }
+static esp_err_t server_async_handler(httpd_req_t *req)
+{
+	server_async_req_t async = {
+			.handler = (server_uri_handler_t)req->user_ctx
+	};
 
-    /* Try to open the file from the given path */
-    fd = fopen(filepath, "r");
-    if (!fd) {
-        ESP_LOGE("server", "Failed to read existing file : %s", filepath);
-        /* Respond with 500 Internal Server Error */
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read existing file");
-        return ESP_FAIL;
-    }
+	if (httpd_req_async_handler_begin(req, &async.req) != ESP_OK) {
+		return async.handler(req);
+	}
 
-    ESP_LOGI("server", "Sending file : %s (%ld bytes)...", filename, file_stat.st_size);
-    set_content_type_from_file(req, filename);
-
-    /* Retrieve the pointer to scratch buffer for temporary storage */
-    char *chunk = ((struct file_server_data *)req->user_ctx)->scratch;
-    size_t chunksize;
-    do {
-        /* Read file in chunks into the scratch buffer */
-        chunksize = fread(chunk, 1, SCRATCH_BUFSIZE, fd);
-
-        if (chunksize > 0) {
-            /* Send the buffer contents as HTTP response chunk */
-            if (httpd_resp_send_chunk(req, chunk, chunksize) != ESP_OK) {
-                fclose(fd);
-                ESP_LOGE("server", "File sending failed!");
-                /* Abort sending file */
-                httpd_resp_sendstr_chunk(req, NULL);
-                /* Respond with 500 Internal Server Error */
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send file");
-               return ESP_FAIL;
-           }
-        }
+	if (xQueueSend(server_async_queue, &async, 0) != pdPASS) {
+		ESP_LOGW("server", "No HTTP worker available");
+		httpd_resp_set_status(async.req, "503 Service Unavailable");
+		httpd_resp_send(async.req, NULL, 0);
+		httpd_req_async_handler_complete(async.req);
+	}
 
-        /* Keep looping till the whole file is sent */
-    } while (chunksize != 0);
+	return ESP_OK;
+}
 
-    /* Close file after sending complete */
-    fclose(fd);
-    ESP_LOGI("server", "File sending complete");
+static void server_async_task(void *arg)
+{
+	server_async_req_t async;
 
-    /* Respond with an empty chunk to signal HTTP response completion */
-    httpd_resp_set_hdr(req, "Connection", "close");
-    httpd_resp_send_chunk(req, NULL, 0);
-    return ESP_OK;
+	for (;;) {
+		if (xQueueReceive(server_async_queue, &async, portMAX_DELAY) == pdPASS) {
+			async.handler(async.req);
+			httpd_req_async_handler_complete(async.req);
+		}
+	}
 }
 
-static const char* get_path_from_uri(char *dest, const char *base_path,
-		const char *uri, size_t dest_size)
+static esp_err_t asset_get_handler(httpd_req_t *req)
 {
-	const size_t base_path_len = strlen(base_path);
-	size_t path_len = strlen(uri);
-
-	const char *quest = strchr(uri, '?');
-	if (quest)
-		path_len = MIN(path_len, quest - uri);
+    char etag[sizeof(((assets_entry_t *)0)->etag)];
 
-	const char *hash = strchr(uri, '#');
-	path_len = MIN(path_len, hash - uri);
+    /* The query and fragment are not part of the name */
+    const char *uri = req->uri;
+    size_t len = strcspn(uri, "?#");
 
-	if (base_path_len + path_len + 1 > dest_size)
-		return NULL;
+    /* Return index.html when URI is empty */
+    if (len == 1) {
+        uri = "/index.html";
+        len = strlen(uri);
+    }
 
-	strcpy(dest, base_path);
-	strlcpy(dest + base_path_len, uri, path_len + 1);
+    const assets_entry_t *asset = assets_find(server_assets, uri, len);
 
-	return dest + base_path_len;
-}
+    if (asset == NULL) {
+        ESP_LOGE("server", "File not found : %.*s", (int)len, uri);
+        /* Respond with 404 Not Found */
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File does not exist");
+        return ESP_FAIL;
+    }
 
+    /* Type, ETag and caching are precomputed in the index */
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control",
+                       asset->flags & ASSETS_FLAG_REVALIDATE ? "no-cache" :
+                       SERVER_ASSETS_MAX_AGE);
 
-static esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filename)
-{
-    if (IS_FILE_EXT(filename, ".pdf")) {
-        return httpd_resp_set_type(req, "application/pdf");
-    } else if (IS_FILE_EXT(filename, ".html")) {
-        return httpd_resp_set_type(req, "text/html");
-    } else if (IS_FILE_EXT(filename, ".jpeg")) {
-        return httpd_resp_set_type(req, "image/jpeg");
-    } else if (IS_FILE_EXT(filename, ".ico")) {
-        return httpd_resp_set_type(req, "image/x-icon");
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", etag,
+            sizeof(etag)) == ESP_OK && !strcmp(etag, asset->etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
     }
-    else if (IS_FILE_EXT(filename, ".svg")) {
-        return httpd_resp_set_type(req, "image/svg+xml");
+
+    httpd_resp_set_type(req, asset->type);
+
+    if (asset->flags & ASSETS_FLAG_GZIP) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
     }
 
-    /* This is a limited set only */
-    /* For any other type always set as plain text */
-    return httpd_resp_set_type(req, "text/plain");
+    /* Sent straight from the flash mapping */
+    return httpd_resp_send(req,
+            (const char *)assets_get_data(server_assets, asset), asset->len);
 }
 
-/***************************** END OF FILE ************************************/
+static void server_buffer_release(void *ctx)
+{
+	char *buf = ctx;
+
+	xQueueSend(server_buffers_free, &buf, 0);
+}
 
+/***************************** END OF FILE ************************************/
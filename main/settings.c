@@ -43,6 +43,8 @@
 #define SETTINGS_SSID_DEFAULT "NearFi"
 #define SETTINGS_CLIENTS_DEFAULT 15
 #define SETTINGS_TIME_DEFAULT 60000
+#define SETTINGS_RATE_DEFAULT 0 /* Unlimited */
+#define SETTINGS_BURST_DEFAULT 64
 
 /* External variables --------------------------------------------------------*/
 
@@ -56,6 +58,8 @@ typedef struct {
   char ssid[32];
   uint8_t clients_num;
   uint16_t time;
+  uint16_t rate;  /* Per-client rate limit in kbit/s, 0 for unlimited */
+  uint16_t burst; /* Per-client burst in KiB */
 } settings_data_t;
 
 typedef struct {
@@ -90,6 +94,11 @@ void settings_set_time(settings_t *const me, uint16_t time) {
   me->data.time = time;
 }
 
+void settings_set_limit(settings_t *const me, uint16_t rate, uint16_t burst) {
+  me->data.rate = rate;
+  me->data.burst = burst;
+}
+
 char *settings_get_ssid(settings_t *const me) { return me->data.ssid; }
 
 uint8_t settings_get_clients(settings_t *const me) {
@@ -98,6 +107,10 @@ uint8_t settings_get_clients(settings_t *const me) {
 
 uint16_t settings_get_time(settings_t *const me) { return me->data.time; }
 
+uint16_t settings_get_rate(settings_t *const me) { return me->data.rate; }
+
+uint16_t settings_get_burst(settings_t *const me) { return me->data.burst; }
+
 bool settings_save(settings_t *const me) {
   if (me->write(SETTINGS_EEPROM_ADDR, (uint8_t *)&me->data, sizeof(settings_data_t)) != 0) {
     return false;
@@ -115,6 +128,14 @@ bool settings_load(settings_t *const me) {
     settings_set_ssid(me, SETTINGS_SSID_DEFAULT);
     settings_set_clients(me, SETTINGS_CLIENTS_DEFAULT);
     settings_set_time(me, SETTINGS_TIME_DEFAULT);
+    settings_set_limit(me, SETTINGS_RATE_DEFAULT, SETTINGS_BURST_DEFAULT);
+
+    if (!settings_save(me)) {
+      return false;
+    }
+  } else if (me->data.rate == 0xFFFF && me->data.burst == 0xFFFF) {
+    /* Settings saved before the rate limit fields existed */
+    settings_set_limit(me, SETTINGS_RATE_DEFAULT, SETTINGS_BURST_DEFAULT);
 
     if (!settings_save(me)) {
       return false;
@@ -0,0 +1,537 @@
+/**
+ ******************************************************************************
+ * @file           : traffic.c
+ * @author         : Mauricio Barroso Benavides
+ * @date           : Oct, 2026
+ * @brief          : Per-client traffic accounting on the AP interface
+ ******************************************************************************
+ * @attention
+ *
+ * MIT License
+ *
+ * Copyright (c) 2026 Mauricio Barroso Benavides
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_netif_net_stack.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcpip.h"
+#include "sdkconfig.h"
+
+#include "drr.h"
+
+/* Private macros ------------------------------------------------------------*/
+#ifndef TRAFFIC_CLIENTS_MAX
+#define TRAFFIC_CLIENTS_MAX CONFIG_LWIP_DHCPS_MAX_STATION_NUM
+#endif
+
+/* Counters slots, one per last octet of the AP subnet addresses */
+#define TRAFFIC_SLOTS 256
+
+/* Ethernet II + IPv4 header offsets */
+#define TRAFFIC_ETH_TYPE 12
+#define TRAFFIC_IP_SRC 26
+#define TRAFFIC_IP_DST 30
+#define TRAFFIC_IP_MIN_LEN 34
+
+/* Frames waiting for the fair queue scheduler */
+#define TRAFFIC_INBOX_LEN 32
+
+/* Smallest burst, a full frame must always fit in a bucket */
+#define TRAFFIC_BURST_MIN (1514 * 8)
+
+/* External variables --------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum {
+  TRAFFIC_DIR_RX = 0, /* From the uplink to the client */
+  TRAFFIC_DIR_TX,     /* From the client to the uplink */
+  TRAFFIC_DIR_MAX
+} traffic_dir_t;
+
+/* Forwarding path counters, only added to there and drained by the
+ * snapshots */
+typedef struct {
+  atomic_uint_least32_t bytes[TRAFFIC_DIR_MAX];
+  atomic_uint_least32_t packets[TRAFFIC_DIR_MAX];
+  atomic_uint_least32_t drops[TRAFFIC_DIR_MAX]; /* Rate limit and queues */
+} traffic_counter_t;
+
+/* Token bucket refilled on each packet, only used by the hook of its
+ * direction so it needs no locking */
+typedef struct {
+  uint32_t tokens; /* Bits */
+  uint32_t time;   /* Last refill in ms */
+} traffic_bucket_t;
+
+typedef struct {
+  uint8_t mac[6];
+  uint8_t octet; /* Last octet of the client address */
+  uint64_t bytes[TRAFFIC_DIR_MAX];
+  uint64_t packets[TRAFFIC_DIR_MAX];
+  uint64_t drops[TRAFFIC_DIR_MAX];
+  uint32_t bps[TRAFFIC_DIR_MAX]; /* Rate over the last snapshot period */
+  int64_t seen;                  /* Last snapshot with traffic or a lease */
+} traffic_client_t;
+
+typedef struct {
+  traffic_client_t client[TRAFFIC_CLIENTS_MAX];
+  uint8_t num;
+  int64_t time;
+} traffic_snapshot_t;
+
+typedef struct {
+  esp_netif_t *ap_netif;
+  esp_netif_t *sta_netif;
+  struct netif *netif;
+  netif_input_fn input;
+  netif_linkoutput_fn linkoutput;
+  netif_linkoutput_fn sta_linkoutput;
+  QueueHandle_t inbox;   /* Frames to the uplink, NULL without fair queue */
+  drr_t drr;             /* Only touched by the scheduler */
+  atomic_bool congested; /* The uplink refused a frame */
+  uint8_t subnet[3];     /* First octets of the AP address */
+  uint8_t host;          /* Last octet of the AP address */
+  uint32_t rate;         /* Per-client limit in kbit/s, 0 for unlimited */
+  uint32_t burst;        /* Per-client burst in bits */
+  traffic_counter_t counter[TRAFFIC_SLOTS];
+  traffic_bucket_t bucket[TRAFFIC_SLOTS][TRAFFIC_DIR_MAX];
+  uint8_t mac[TRAFFIC_SLOTS][6];
+  atomic_bool leased[TRAFFIC_SLOTS]; /* New lease not seen by a snapshot */
+  traffic_snapshot_t snapshot[2];
+  atomic_uint_least32_t count; /* Snapshots taken, the last one is read */
+} traffic_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* The lwIP hooks have no context argument */
+static traffic_t *traffic_instance;
+
+/* Private function prototypes -----------------------------------------------*/
+static err_t traffic_input(struct pbuf *p, struct netif *netif);
+static err_t traffic_linkoutput(struct netif *netif, struct pbuf *p);
+static err_t traffic_sta_linkoutput(struct netif *netif, struct pbuf *p);
+static bool traffic_forward(traffic_t *const me, const struct pbuf *p,
+                            traffic_dir_t dir, bool queued);
+static void traffic_count(traffic_counter_t *counter, traffic_dir_t dir,
+                          uint32_t len);
+static bool traffic_uplink(traffic_t *const me, const struct pbuf *p);
+static bool traffic_bucket_take(traffic_t *const me, traffic_bucket_t *bucket,
+                                uint32_t bits);
+
+/* Exported functions definitions --------------------------------------------*/
+esp_err_t traffic_init(traffic_t *const me, esp_netif_t *ap_netif,
+                       esp_netif_t *sta_netif, const char *ap_ip) {
+  ESP_LOGI("traffic", "Initializing traffic accounting...");
+
+  if (ap_netif == NULL || sta_netif == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  memset(me, 0, sizeof(traffic_t));
+
+  uint32_t addr = ipaddr_addr(ap_ip);
+  memcpy(me->subnet, &addr, sizeof(me->subnet));
+  me->host = ((const uint8_t *)&addr)[3];
+  me->snapshot[0].time = me->snapshot[1].time = esp_timer_get_time();
+
+  /* The hooks are installed once the interfaces are started */
+  traffic_instance = me;
+  me->ap_netif = ap_netif;
+  me->sta_netif = sta_netif;
+
+  return ESP_OK;
+}
+
+esp_err_t traffic_attach_ap(traffic_t *const me) {
+  struct netif *netif = esp_netif_get_netif_impl(me->ap_netif);
+
+  /* Only set once the interface is added to lwIP, when the AP starts */
+  if (netif == NULL || netif->input == NULL || netif->linkoutput == NULL) {
+    ESP_LOGE("traffic", "AP interface not ready");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  /* Wrap the AP interface input and output to see every forwarded frame.
+   * Adding the interface again on an AP restart resets both, so they are
+   * wrapped again on each start */
+  LOCK_TCPIP_CORE();
+
+  if (netif->input != traffic_input) {
+    me->input = netif->input;
+    netif->input = traffic_input;
+  }
+
+  if (netif->linkoutput != traffic_linkoutput) {
+    me->linkoutput = netif->linkoutput;
+    netif->linkoutput = traffic_linkoutput;
+  }
+
+  me->netif = netif;
+  UNLOCK_TCPIP_CORE();
+
+  ESP_LOGI("traffic", "AP interface hooks installed");
+
+  return ESP_OK;
+}
+
+esp_err_t traffic_attach_sta(traffic_t *const me) {
+  struct netif *netif = esp_netif_get_netif_impl(me->sta_netif);
+
+  if (netif == NULL || netif->linkoutput == NULL) {
+    ESP_LOGE("traffic", "STA interface not ready");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  /* The uplink output only reports when its buffers are full */
+  LOCK_TCPIP_CORE();
+
+  if (netif->linkoutput != traffic_sta_linkoutput) {
+    me->sta_linkoutput = netif->linkoutput;
+    netif->linkoutput = traffic_sta_linkoutput;
+  }
+
+  UNLOCK_TCPIP_CORE();
+
+  ESP_LOGI("traffic", "STA interface hooks installed");
+
+  return ESP_OK;
+}
+
+esp_err_t traffic_fair_queue_init(traffic_t *const me, uint16_t depth,
+                                  uint32_t limit, uint16_t quantum) {
+  esp_err_t ret = drr_init(&me->drr, depth, limit, quantum);
+
+  if (ret != ESP_OK) {
+    return ret;
+  }
+
+  me->inbox = xQueueCreate(TRAFFIC_INBOX_LEN, sizeof(struct pbuf *));
+
+  if (me->inbox == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  return ESP_OK;
+}
+
+void traffic_set_limit(traffic_t *const me, uint16_t rate_kbps,
+                       uint16_t burst_kib) {
+  uint32_t burst = (uint32_t)burst_kib * 1024 * 8;
+
+  /* Set before the AP starts, the hooks read it without locking */
+  me->rate = rate_kbps;
+  me->burst = burst < TRAFFIC_BURST_MIN ? TRAFFIC_BURST_MIN : burst;
+
+  if (rate_kbps) {
+    ESP_LOGI("traffic", "Per-client limit: %u kbit/s, burst %lu bytes",
+             rate_kbps, me->burst / 8);
+  }
+}
+
+void traffic_lease(traffic_t *const me, const esp_ip4_addr_t *ip,
+                   const uint8_t *mac) {
+  uint8_t octet = esp_ip4_addr4(ip);
+
+  memcpy(me->mac[octet], mac, 6);
+  atomic_store(&me->leased[octet], true);
+}
+
+void traffic_snapshot(traffic_t *const me) {
+  uint32_t count = atomic_load(&me->count);
+  const traffic_snapshot_t *prev = &me->snapshot[count & 1];
+  traffic_snapshot_t *next = &me->snapshot[(count + 1) & 1];
+  int64_t now = esp_timer_get_time();
+  int64_t period = now - prev->time;
+
+  /* Start from the previous totals, the slots leased again begin from zero */
+  memcpy(next, prev, sizeof(traffic_snapshot_t));
+  next->time = now;
+
+  for (uint8_t i = 0; i < next->num; i++) {
+    memset(next->client[i].bps, 0, sizeof(next->client[i].bps));
+  }
+
+  for (uint16_t octet = 0; octet < TRAFFIC_SLOTS; octet++) {
+    traffic_counter_t *counter = &me->counter[octet];
+    bool leased = atomic_exchange(&me->leased[octet], false);
+    uint32_t bytes[TRAFFIC_DIR_MAX], packets[TRAFFIC_DIR_MAX];
+    uint32_t drops[TRAFFIC_DIR_MAX];
+    bool seen = leased;
+
+    for (uint8_t dir = 0; dir < TRAFFIC_DIR_MAX; dir++) {
+      bytes[dir] = atomic_exchange(&counter->bytes[dir], 0);
+      packets[dir] = atomic_exchange(&counter->packets[dir], 0);
+      drops[dir] = atomic_exchange(&counter->drops[dir], 0);
+      seen |= packets[dir] != 0 || drops[dir] != 0;
+    }
+
+    if (!seen) {
+      continue;
+    }
+
+    traffic_client_t *client = NULL;
+    traffic_client_t *oldest = &next->client[0];
+
+    for (uint8_t i = 0; i < next->num; i++) {
+      if (next->client[i].octet == octet) {
+        client = &next->client[i];
+        break;
+      }
+
+      if (next->client[i].seen < oldest->seen) {
+        oldest = &next->client[i];
+      }
+    }
+
+    if (client == NULL || leased) {
+      /* A new client takes a free entry or the one idle for longer */
+      if (client == NULL) {
+        client = next->num < TRAFFIC_CLIENTS_MAX ? &next->client[next->num++]
+                                                 : oldest;
+      }
+
+      memset(client, 0, sizeof(traffic_client_t));
+      memcpy(client->mac, me->mac[octet], 6);
+      client->octet = octet;
+    }
+
+    client->seen = now;
+
+    for (uint8_t dir = 0; dir < TRAFFIC_DIR_MAX; dir++) {
+      client->bytes[dir] += bytes[dir];
+      client->packets[dir] += packets[dir];
+      client->drops[dir] += drops[dir];
+      client->bps[dir] = period > 0 ? bytes[dir] * 8000000ULL / period : 0;
+    }
+  }
+
+  atomic_store(&me->count, count + 1);
+}
+
+bool traffic_get_client(traffic_t *const me, uint8_t i,
+                        traffic_client_t *client) {
+  uint32_t count;
+  bool found;
+
+  /* The snapshot read is overwritten by the one after the next, so each
+   * client is copied out and copied again if a snapshot was taken meanwhile */
+  do {
+    count = atomic_load(&me->count);
+    const traffic_snapshot_t *snapshot = &me->snapshot[count & 1];
+    found = i < snapshot->num;
+
+    if (found) {
+      memcpy(client, &snapshot->client[i], sizeof(traffic_client_t));
+    }
+  } while (atomic_load(&me->count) != count);
+
+  return found;
+}
+
+void traffic_schedule(traffic_t *const me) {
+  struct pbuf *p;
+  uint8_t id;
+
+  /* Back off a tick after the uplink refused a frame, the backlog builds up
+   * in the client queues instead of the Wi-Fi buffers */
+  bool congested = atomic_exchange(&me->congested, false);
+  TickType_t wait = drr_empty(&me->drr) ? portMAX_DELAY : 0;
+
+  if (congested) {
+    wait = 1;
+  }
+
+  while (xQueueReceive(me->inbox, &p, wait) == pdTRUE) {
+    wait = 0;
+
+    /* Overflows drop the oldest frame of the longest queue */
+    id = ((const uint8_t *)p->payload)[TRAFFIC_IP_SRC + 3];
+
+    while (!drr_fits(&me->drr, id, p->tot_len)) {
+      uint8_t dropped = drr_drop(&me->drr, id);
+      atomic_fetch_add_explicit(&me->counter[dropped].drops[TRAFFIC_DIR_TX],
+                                1, memory_order_relaxed);
+    }
+
+    drr_enqueue(&me->drr, id, p);
+  }
+
+  while (!atomic_load(&me->congested) &&
+         (p = drr_dequeue(&me->drr, &id)) != NULL) {
+    uint32_t len = p->tot_len;
+
+    if (me->input(p, me->netif) != ERR_OK) {
+      /* The input runs in this task with the core locked, so a refused frame
+       * means the stack is out of buffers, same as a busy uplink */
+      pbuf_free(p);
+      atomic_fetch_add_explicit(&me->counter[id].drops[TRAFFIC_DIR_TX], 1,
+                                memory_order_relaxed);
+      atomic_store(&me->congested, true);
+    } else {
+      traffic_count(&me->counter[id], TRAFFIC_DIR_TX, len);
+    }
+
+    /* Let the new arrivals join the round */
+    if (uxQueueMessagesWaiting(me->inbox)) {
+      break;
+    }
+  }
+}
+
+/* Private function definitions ----------------------------------------------*/
+static err_t traffic_input(struct pbuf *p, struct netif *netif) {
+  traffic_t *me = traffic_instance;
+  bool queued = me->inbox != NULL && traffic_uplink(me, p);
+
+  if (!traffic_forward(me, p, TRAFFIC_DIR_TX, queued)) {
+    /* The input function owns the frame */
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  if (!queued) {
+    return me->input(p, netif);
+  }
+
+  /* To the uplink through the fair queue scheduler */
+  if (xQueueSend(me->inbox, &p, 0) != pdTRUE) {
+    const uint8_t *frame = p->payload;
+    atomic_fetch_add_explicit(
+        &me->counter[frame[TRAFFIC_IP_SRC + 3]].drops[TRAFFIC_DIR_TX], 1,
+        memory_order_relaxed);
+    pbuf_free(p);
+  }
+
+  return ERR_OK;
+}
+
+static err_t traffic_linkoutput(struct netif *netif, struct pbuf *p) {
+  if (!traffic_forward(traffic_instance, p, TRAFFIC_DIR_RX, false)) {
+    /* Silently dropped, the caller frees the frame */
+    return ERR_OK;
+  }
+
+  return traffic_instance->linkoutput(netif, p);
+}
+
+static err_t traffic_sta_linkoutput(struct netif *netif, struct pbuf *p) {
+  err_t err = traffic_instance->sta_linkoutput(netif, p);
+
+  if (err == ERR_MEM) {
+    atomic_store(&traffic_instance->congested, true);
+  }
+
+  return err;
+}
+
+static bool traffic_forward(traffic_t *const me, const struct pbuf *p,
+                            traffic_dir_t dir, bool queued) {
+  const uint8_t *frame = p->payload;
+
+  /* Only IPv4 frames of the AP subnet are accounted */
+  if (p->len < TRAFFIC_IP_MIN_LEN || frame[TRAFFIC_ETH_TYPE] != 0x08 ||
+      frame[TRAFFIC_ETH_TYPE + 1] != 0x00) {
+    return true;
+  }
+
+  const uint8_t *ip =
+      &frame[dir == TRAFFIC_DIR_TX ? TRAFFIC_IP_SRC : TRAFFIC_IP_DST];
+  const uint8_t *peer =
+      &frame[dir == TRAFFIC_DIR_TX ? TRAFFIC_IP_DST : TRAFFIC_IP_SRC];
+
+  if (memcmp(ip, me->subnet, sizeof(me->subnet))) {
+    return true;
+  }
+
+  traffic_counter_t *counter = &me->counter[ip[3]];
+
+  /* Only the forwarded traffic is limited, the DNS and web server of the AP
+   * stay reachable */
+  bool local = !memcmp(peer, me->subnet, sizeof(me->subnet)) &&
+               peer[3] == me->host;
+
+  if (me->rate && !local &&
+      !traffic_bucket_take(me, &me->bucket[ip[3]][dir], p->tot_len * 8)) {
+    atomic_fetch_add_explicit(&counter->drops[dir], 1, memory_order_relaxed);
+    return false;
+  }
+
+  /* The queued frames are only counted as sent once they leave the fair
+   * queue, the ones dropped there count as drops alone */
+  if (!queued) {
+    traffic_count(counter, dir, p->tot_len);
+  }
+
+  return true;
+}
+
+static void traffic_count(traffic_counter_t *counter, traffic_dir_t dir,
+                          uint32_t len) {
+  atomic_fetch_add_explicit(&counter->bytes[dir], len, memory_order_relaxed);
+  atomic_fetch_add_explicit(&counter->packets[dir], 1, memory_order_relaxed);
+}
+
+static bool traffic_uplink(traffic_t *const me, const struct pbuf *p) {
+  const uint8_t *frame = p->payload;
+
+  /* IPv4 from a client address to outside of the AP subnet */
+  return p->len >= TRAFFIC_IP_MIN_LEN && frame[TRAFFIC_ETH_TYPE] == 0x08 &&
+         frame[TRAFFIC_ETH_TYPE + 1] == 0x00 &&
+         !memcmp(&frame[TRAFFIC_IP_SRC], me->subnet, sizeof(me->subnet)) &&
+         memcmp(&frame[TRAFFIC_IP_DST], me->subnet, sizeof(me->subnet));
+}
+
+static bool traffic_bucket_take(traffic_t *const me, traffic_bucket_t *bucket,
+                                uint32_t bits) {
+  uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+  uint32_t elapsed = now - bucket->time;
+
+  /* Refill with the time since the last packet, a kbit/s is a bit per ms */
+  if (elapsed) {
+    uint64_t tokens = bucket->tokens + (uint64_t)elapsed * me->rate;
+    bucket->tokens = tokens < me->burst ? tokens : me->burst;
+    bucket->time = now;
+  }
+
+  if (bucket->tokens < bits) {
+    return false;
+  }
+
+  bucket->tokens -= bits;
+
+  return true;
+}
+
+/***************************** END OF FILE ************************************/
@@ -41,10 +41,12 @@ extern "C" {
 #endif
 
 /* Includes ------------------------------------------------------------------*/
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 #include "lwip/stats.h"
+#include "multi_heap.h"
 
 /* Exported Macros -----------------------------------------------------------*/
 
@@ -100,8 +102,6 @@ typedef enum {
 	EVENT_TRG_HEALTH_INTERNET,
 	EVENT_TRG_HEALTH_NO_INTERNET,
 	
-	EVENT_TRG_WDT,
-	EVENT_TRG_TICK,
 	EVENT_TRG_IP_GOT,
 	
 	EVENT_TRG_MAX
@@ -151,38 +151,50 @@ typedef enum {
 	
 	EVENT_CMD_CLIENTS_ADD,
 	EVENT_CMD_CLIENTS_REMOVE,
-	EVENT_CMD_CLIENTS_TICK,
 	EVENT_CMD_CLIENTS_MAX,
 	
 	EVENT_CMD_ACTIONS_RESET,
 	EVENT_CMD_ACTIONS_RESTORE,
-	EVENT_CMD_ACTIONS_WDT,
 	EVENT_CMD_ACTIONS_MAX,
 	
 	EVENT_CMD_MAX	
 } event_cmd_t;
 
 typedef struct {
-	int num;
+	struct stats_ip_napt napt_stats;
+	multi_heap_info_t heap_dram;
+	multi_heap_info_t heap_psram;
+	uint32_t ip_forwarded;
+	uint32_t ip_dropped;
+} event_health_t;
+
+/* Large event data, taken from the events pool and shared by reference */
+typedef struct {
+	atomic_uint_least8_t refs;
+	union {
+		event_health_t health;
+	} data;
+} event_payload_t;
+
+/* Fixed size header copied through the queues */
+typedef struct {
+	uint8_t num;
 	union {
 		struct {
 			uint8_t aid;
 			uint8_t mac[6];
 		} client;
-		struct {
-			struct stats_ip_napt napt_stats;
-			multi_heap_info_t heap_dram;
-			multi_heap_info_t heap_psram;
-		} health;
 	} data;
+	event_payload_t *payload;
 	uint32_t timestamp;	
 } event_t; 
 
 typedef void (*event_cb_t)(event_t *const event);
 
+/* Commands an event fans out to */
 typedef struct {
-	event_trg_t event;
-	event_cmd_t command;
+	const event_cmd_t *cmds;
+	uint8_t num;
 } event_route_t;
 
 typedef enum {
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+#
+# Compile hosts style blocklists into the binary image that the firmware
+# maps from the "blocklist" partition.
+#
+# Lines are "<address> <host>" or "<host>". A host written as "*.example.com"
+# is a wildcard rule that blocks example.com and every name below it, the
+# exact entries already covered by a wildcard rule are dropped.
+#
+# Image layout (little endian):
+#   header   magic "NFBL", version (u16), bucket bits (u16), count (u32),
+#            reserved (u32)
+#   buckets  (1 << bucket bits) + 1 u32 indexes into the hashes array, one
+#            per value of the hash top bits
+#   hashes   count sorted u64 keys, each one is the FNV-1a hash of the lower
+#            case name with its labels in reverse order ("net.doubleclick"),
+#            with the bit 0 set for wildcard rules and clear for exact names
+#
+# MIT License
+#
+# Copyright (c) 2026 Mauricio Barroso Benavides
+
+import argparse
+import struct
+import sys
+
+MAGIC = b'NFBL'
+VERSION = 2
+BUCKET_BITS = 12
+
+FNV_OFFSET = 0xCBF29CE484222325
+FNV_PRIME = 0x100000001B3
+MASK64 = 0xFFFFFFFFFFFFFFFF
+
+
+def fnv1a(data, h=FNV_OFFSET):
+    for c in data:
+        h ^= c
+        h = (h * FNV_PRIME) & MASK64
+    return h
+
+
+def name_hash(name):
+    # Same label chain the firmware computes from the top level domain down
+    return fnv1a(b'.'.join(reversed(name.split(b'.'))))
+
+
+def parse_hosts(paths):
+    exact = set()
+    wildcard = set()
+    for path in paths:
+        with open(path, 'rb') as f:
+            for line in f:
+                line = line.split(b'#', 1)[0].split()
+                if not line:
+                    continue
+                # Hosts file lines are "<address> <host>", plain lists "<host>"
+                host = line[1] if len(line) > 1 else line[0]
+                host = host.lower().rstrip(b'.')
+                if host.startswith(b'*.'):
+                    wildcard.add(host[2:])
+                elif host and host != b'localhost':
+                    exact.add(host)
+    return exact, wildcard
+
+
+def covered(name, wildcard, strict):
+    labels = name.split(b'.')
+    for i in range(1 if strict else 0, len(labels)):
+        if b'.'.join(labels[i:]) in wildcard:
+            return True
+    return False
+
+
+def build_keys(exact, wildcard):
+    keys = set()
+    for name in wildcard:
+        if not covered(name, wildcard, True):
+            keys.add(name_hash(name) | 1)
+    for name in exact:
+        if not covered(name, wildcard, False):
+            keys.add(name_hash(name) & ~1)
+    return keys
+
+
+def build_image(keys):
+    hashes = sorted(keys)
+    buckets = [0] * ((1 << BUCKET_BITS) + 1)
+
+    for h in hashes:
+        buckets[(h >> (64 - BUCKET_BITS)) + 1] += 1
+    for i in range(1, len(buckets)):
+        buckets[i] += buckets[i - 1]
+
+    image = struct.pack('<4sHHII', MAGIC, VERSION, BUCKET_BITS, len(hashes), 0)
+    image += struct.pack('<%dI' % len(buckets), *buckets)
+    image += struct.pack('<%dQ' % len(hashes), *hashes)
+    return image, len(hashes)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compile a hosts file into a NearFi blocklist image')
+    parser.add_argument('output', help='binary image to generate')
+    parser.add_argument('input', nargs='+',
+                        help='hosts files with the blocked domains')
+    parser.add_argument('--size', type=lambda x: int(x, 0), default=0,
+                        help='partition size, the image must fit in it')
+    args = parser.parse_args()
+
+    exact, wildcard = parse_hosts(args.input)
+    image, count = build_image(build_keys(exact, wildcard))
+
+    if args.size and len(image) > args.size:
+        sys.exit('blocklist image (%d bytes) does not fit in the partition '
+                 '(%d bytes)' % (len(image), args.size))
+
+    with open(args.output, 'wb') as f:
+        f.write(image)
+
+    print('Blocklist image: %d exact, %d wildcard, %d keys, %d bytes' %
+          (len(exact), len(wildcard), count, len(image)))
+
+
+if __name__ == '__main__':
+    main()
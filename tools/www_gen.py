@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+#
+# Pack the web assets into the image flashed to the "www" partition, which the
+# firmware maps and sends the responses from.
+#
+# The text assets are minified by dropping the indentation and the blank
+# lines. Every asset is gzip compressed when that saves at least 5%,
+# otherwise it is stored as is (images already compressed). The gzip header
+# carries no name nor time, so the image only changes with the content.
+#
+# Image layout (little endian):
+#   header   magic "NFWW", version (u16), count (u16)
+#   entries  count entries of 80 bytes sorted by name: name (24 bytes,
+#            "/index.html"), MIME type (24 bytes), ETag (20 bytes, the quoted
+#            FNV-1a hash of the stored bytes), all zero padded, then offset
+#            from the image start (u32), size (u32) and flags (u32, bit 0 set
+#            for gzip, bit 1 for the pages revalidated on each load)
+#   data     the assets, 4 bytes aligned
+#
+# MIT License
+#
+# Copyright (c) 2026 Mauricio Barroso Benavides
+
+import argparse
+import gzip
+import os
+import struct
+import sys
+
+MAGIC = b'NFWW'
+VERSION = 2
+NAME_LEN = 24
+TYPE_LEN = 24
+ETAG_LEN = 20
+ENTRY = '<%ds%ds%dsIII' % (NAME_LEN, TYPE_LEN, ETAG_LEN)
+FLAG_GZIP = 1 << 0
+FLAG_REVALIDATE = 1 << 1
+
+MIME_TYPES = {
+    '.html': 'text/html',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.json': 'application/json',
+    '.png': 'image/png',
+    '.jpeg': 'image/jpeg',
+    '.jpg': 'image/jpeg',
+    '.svg': 'image/svg+xml',
+    '.ico': 'image/x-icon',
+    '.pdf': 'application/pdf',
+}
+
+MINIFY_EXT = ('.html', '.css', '.js')
+
+FNV_OFFSET = 0xCBF29CE484222325
+FNV_PRIME = 0x100000001B3
+MASK64 = 0xFFFFFFFFFFFFFFFF
+
+
+def fnv1a(data, h=FNV_OFFSET):
+    for c in data:
+        h ^= c
+        h = (h * FNV_PRIME) & MASK64
+    return h
+
+
+def minify(data):
+    # Line based only, safe as long as no string spans several lines
+    lines = (line.strip() for line in data.split(b'\n'))
+    return b'\n'.join(line for line in lines if line)
+
+
+def pack(paths):
+    assets = []
+    # Sorted by name, the firmware binary searches the index
+    for path in sorted(paths, key=os.path.basename):
+        name = '/' + os.path.basename(path)
+        if len(name) >= NAME_LEN:
+            sys.exit('asset name too long: %s' % name)
+
+        ext = os.path.splitext(name)[1].lower()
+        mime = MIME_TYPES.get(ext, 'text/plain')
+
+        with open(path, 'rb') as f:
+            data = f.read()
+
+        if name.endswith(MINIFY_EXT):
+            data = minify(data)
+
+        # The pages are revalidated on each load to pick up an update
+        flags = FLAG_REVALIDATE if ext == '.html' else 0
+        packed = gzip.compress(data, compresslevel=9, mtime=0)
+        if len(packed) < len(data) * 0.95:
+            data = packed
+            flags |= FLAG_GZIP
+
+        assets.append((name, mime, data, flags))
+
+    offset = 8 + len(assets) * struct.calcsize(ENTRY)
+    index = struct.pack('<4sHH', MAGIC, VERSION, len(assets))
+    blob = b''
+    for name, mime, data, flags in assets:
+        etag = '"%016x"' % fnv1a(data)
+        index += struct.pack(ENTRY, name.encode(), mime.encode(),
+                             etag.encode(), offset + len(blob), len(data),
+                             flags)
+        blob += data + b'\0' * (-len(data) % 4)
+
+    return index + blob, assets
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Pack the NearFi web assets into an image')
+    parser.add_argument('output', help='image to generate')
+    parser.add_argument('input', nargs='+', help='web assets')
+    parser.add_argument('--size', type=lambda x: int(x, 0), default=0,
+                        help='partition size, the image must fit in it')
+    args = parser.parse_args()
+
+    image, assets = pack(args.input)
+
+    if args.size and len(image) > args.size:
+        sys.exit('web assets image (%d bytes) does not fit in the partition '
+                 '(%d bytes)' % (len(image), args.size))
+
+    with open(args.output, 'wb') as f:
+        f.write(image)
+
+    for name, mime, data, flags in assets:
+        print('Web asset %s: %d bytes%s' %
+              (name, len(data), ' gzip' if flags & FLAG_GZIP else ''))
+    print('Web assets image: %d files, %d bytes' % (len(assets), len(image)))
+
+
+if __name__ == '__main__':
+    main()